@@ -17,6 +17,7 @@ HEADERS		+= src/clientdlg.h
 HEADERS		+= src/compressor.h
 HEADERS		+= src/configdlg.h
 HEADERS		+= src/connectdlg.h
+HEADERS		+= src/denormal.h
 HEADERS		+= src/eqdlg.h
 HEADERS		+= src/equalizer.h
 HEADERS		+= src/helpdlg.h
@@ -27,6 +28,7 @@ HEADERS		+= src/midibuffer.h
 HEADERS		+= src/mixerdlg.h
 HEADERS		+= src/multiply.h
 HEADERS		+= src/peer.h
+HEADERS		+= src/pool.h
 HEADERS		+= src/protocol.h
 HEADERS		+= src/socket.h
 HEADERS		+= src/spectralysis.h
@@ -51,6 +53,7 @@ SOURCES		+= src/midibuffer.cpp
 SOURCES		+= src/mixerdlg.cpp
 SOURCES		+= src/multiply.cpp
 SOURCES		+= src/peer.cpp
+SOURCES		+= src/pool.cpp
 SOURCES		+= src/protocol.cpp
 SOURCES		+= src/recordingdlg.cpp
 SOURCES		+= src/socket.cpp
@@ -60,6 +63,7 @@ SOURCES		+= src/timer.cpp
 SOURCES		+= src/texture.cpp
 
 SOURCES		+= kissfft/kiss_fft.c
+SOURCES		+= kissfft/kiss_fftr.c
 
 macx {
 HEADERS		+= mac/activity.h
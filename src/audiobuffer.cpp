@@ -23,124 +23,418 @@
  * SUCH DAMAGE.
  */
 
+#include <stdlib.h>
+
 #include "audiobuffer.h"
 #include "spectralysis.h"
 
+/*
+ * Push the completed bucket into the monotonic queues, which keep the
+ * minimum and maximum water levels of the sliding window at the front.
+ */
 void
-hpsjam_audio_buffer :: doAdjustBuffer(int missing)
+hpsjam_audio_buffer :: addWaterBucket()
 {
-	float buffer[HPSJAM_MAX_SAMPLES];
-	float *dst = buffer;
-	size_t fwd = HPSJAM_MAX_SAMPLES - consumer;
-	size_t num = total;
-	size_t to = total - missing;
-
-	/* do nothing, if buffer is empty or nothing is missing */
-	if (missing == 0 || total == 0)
-		return;
+	struct hpsjam_water_entry *pe;
+
+	/* remove levels which can no longer be the minimum */
+	while (water_min_count != 0) {
+		pe = &water_min[(water_min_head + water_min_count - 1) % WATER_MAX];
+		if (pe->value < bucket_low)
+			break;
+		water_min_count--;
+	}
+	pe = &water_min[(water_min_head + water_min_count++) % WATER_MAX];
+	pe->index = water_index;
+	pe->value = bucket_low;
+
+	/* remove levels which can no longer be the maximum */
+	while (water_max_count != 0) {
+		pe = &water_max[(water_max_head + water_max_count - 1) % WATER_MAX];
+		if (pe->value > bucket_high)
+			break;
+		water_max_count--;
+	}
+	pe = &water_max[(water_max_head + water_max_count++) % WATER_MAX];
+	pe->index = water_index;
+	pe->value = bucket_high;
+
+	water_index++;
+
+	/* remove expired buckets */
+	if (water_index - water_min[water_min_head].index > water_buckets) {
+		water_min_head = (water_min_head + 1) % WATER_MAX;
+		water_min_count--;
+	}
+	if (water_index - water_max[water_max_head].index > water_buckets) {
+		water_max_head = (water_max_head + 1) % WATER_MAX;
+		water_max_count--;
+	}
 
-	/* check if target buffer size is sane, else return */
-	if (to < 2 || to > HPSJAM_MAX_SAMPLES)
+	/* start a new bucket */
+	water_fill = 0;
+	bucket_low = HPSJAM_MAX_SAMPLES;
+	bucket_high = 0;
+}
+/*
+ * Switch between mono and stereo frames. All stored frames are
+ * converted, because the history is used for concealment.
+ */
+void
+hpsjam_audio_buffer :: setChannels(unsigned num)
+{
+	if (num == channels)
 		return;
 
-	/* move all samples from ring-buffer to temporary buffer */
+	if (num == 1) {
+		for (size_t x = 0; x != HPSJAM_MAX_SAMPLES; x++)
+			samples[x] = (samples[2 * x] + samples[2 * x + 1]) / 2.0f;
+		for (size_t x = 0; x != fadeSamples; x++)
+			ping_pong_data[0][x] = (ping_pong_data[0][x] + ping_pong_data[1][x]) / 2.0f;
+		last_sample[0] = (last_sample[0] + last_sample[1]) / 2.0f;
+		drift_last[0] = (drift_last[0] + drift_last[1]) / 2.0f;
+	} else {
+		for (size_t x = HPSJAM_MAX_SAMPLES; x-- != 0; ) {
+			const float value = samples[x];
+			samples[2 * x] = value;
+			samples[2 * x + 1] = value;
+		}
+		memcpy(ping_pong_data[1], ping_pong_data[0], sizeof(ping_pong_data[1]));
+		last_sample[1] = last_sample[0];
+		drift_last[1] = drift_last[0];
+	}
+	channels = num;
+}
+
+/* copy frames from the front of the ring-buffer, without consuming them */
+void
+hpsjam_audio_buffer :: copyFront(float *dst, size_t num) const
+{
+	size_t offset = consumer;
+
+	assert(num <= total);
+
 	while (num != 0) {
+		size_t fwd = HPSJAM_MAX_SAMPLES - offset;
 		if (fwd > num)
 			fwd = num;
-		memcpy(dst, samples + consumer, sizeof(samples[0]) * fwd);
-		dst += fwd;
+		memcpy(dst, samples + offset * channels,
+		    sizeof(samples[0]) * channels * fwd);
+		dst += fwd * channels;
 		num -= fwd;
-		consumer += fwd;
-		if (consumer == HPSJAM_MAX_SAMPLES) {
-			consumer = 0;
-			fwd = HPSJAM_MAX_SAMPLES;
-		} else {
-			assert(num == 0);
-			break;
-		}
+		offset = 0;
+	}
+}
+
+/* overwrite frames at the front of the ring-buffer */
+void
+hpsjam_audio_buffer :: writeFront(const float *src, size_t num)
+{
+	size_t offset = consumer;
+
+	assert(num <= total);
+
+	while (num != 0) {
+		size_t fwd = HPSJAM_MAX_SAMPLES - offset;
+		if (fwd > num)
+			fwd = num;
+		memcpy(samples + offset * channels, src,
+		    sizeof(samples[0]) * channels * fwd);
+		src += fwd * channels;
+		num -= fwd;
+		offset = 0;
 	}
+}
+
+/*
+ * Drop or insert a single period of frames at the front of the
+ * buffer. When dropping, the first period is cross-faded into the
+ * second one. When inserting, a cross-fade from the second period
+ * back into the first one is put in between the two.
+ */
+void
+hpsjam_audio_buffer :: doPeriod(size_t period, bool drop)
+{
+	float buffer[2 * maxPeriod * HPSJAM_MAX_CHANNELS];
+	float *first = buffer;
+	float *second = buffer + period * channels;
 
-	/* reset the buffer consumer */
-	consumer = 0;
+	assert(period <= maxPeriod);
 
-	to -= 1;
-	total -= 1;
+	copyFront(buffer, 2 * period);
 
-	/* keep last sample the same */
-	samples[to] = buffer[total];
+	for (size_t x = 0; x != period; x++) {
+		const float w = (x + 0.5f) / period;
 
-	/* linear interpolation */
-	for (size_t x = 0; x < to; ) {
-		size_t src_start = (total * x) / to;
-		size_t src_end;
-		size_t dst_next = x + 1;
+		for (unsigned ch = 0; ch != channels; ch++) {
+			const size_t y = x * channels + ch;
 
-		/* figure out how many samples to input */
-		for (;;) {
-			src_end = (total * dst_next) / to;
-			if (dst_next == to)
-				break;
-			if (src_end != src_start)
-				break;
-			dst_next++;
+			if (drop)
+				second[y] = first[y] + (second[y] - first[y]) * w;
+			else
+				second[y] = second[y] + (first[y] - second[y]) * w;
 		}
+	}
 
-		float start = 0.0f;
+	if (drop) {
+		consumer = (consumer + period) % HPSJAM_MAX_SAMPLES;
+		total -= period;
+		writeFront(second, period);
+	} else {
+		consumer = (consumer + HPSJAM_MAX_SAMPLES - period) % HPSJAM_MAX_SAMPLES;
+		total += period;
+		writeFront(buffer, 2 * period);
+	}
+}
+
+/*
+ * Waveform similarity overlap-add, WSOLA. Search for the period
+ * which best matches the signal at the front of the buffer, and
+ * drop or insert that period. Only a single period is handled per
+ * call, so that the work is spread over multiple ticks. Wait for
+ * either a good match or a quiet spot, before giving up. The
+ * channels are summed for the search.
+ */
+void
+hpsjam_audio_buffer :: doStretch()
+{
+	float frames[(maxPeriod + corrSamples) * HPSJAM_MAX_CHANNELS];
+	float buffer[maxPeriod + corrSamples];
+	const bool drop = (adjust_pending > 0);
+	const size_t pending = drop ? adjust_pending : -adjust_pending;
+	size_t limit = maxPeriod;
+
+	/* don't bother with less than a minimum period */
+	if (pending < minPeriod) {
+		adjust_pending = 0;
+		adjust_wait = 0;
+		return;
+	}
+
+	if (limit > pending)
+		limit = pending;
+	if (limit > total / 2)
+		limit = total / 2;
+	if (total < limit + corrSamples)
+		limit = (total > corrSamples) ? (total - corrSamples) : 0;
+	if (drop == false && limit > HPSJAM_MAX_SAMPLES - total)
+		limit = HPSJAM_MAX_SAMPLES - total;
+
+	/* wait for more samples */
+	if (limit < minPeriod)
+		return;
+
+	copyFront(frames, limit + corrSamples);
+
+	for (size_t x = 0; x != limit + corrSamples; x++) {
+		float sum = 0.0f;
+		for (unsigned ch = 0; ch != channels; ch++)
+			sum += frames[x * channels + ch];
+		buffer[x] = sum;
+	}
+
+	float ea = 0.0f;
+	float eb = 0.0f;
+
+	for (size_t x = 0; x != corrSamples; x++) {
+		ea += buffer[x] * buffer[x];
+		eb += buffer[minPeriod + x] * buffer[minPeriod + x];
+	}
 
-		/* average the samples being compressed */
-		for (size_t y = src_start; y != src_end; y++)
-			start += buffer[y];
+	float best_corr = 0.0f;
+	size_t best = minPeriod;
 
-		if (start != 0.0f)
-			start /= (ssize_t)(src_end - src_start);
+	/* find the best matching period using normalized cross-correlation */
+	for (size_t period = minPeriod; ; period++) {
+		const float norm = ea * eb;
+		float corr = 0.0f;
 
-		float delta = (buffer[src_end] - start) / (ssize_t)(dst_next - x);
+		for (size_t x = 0; x != corrSamples; x++)
+			corr += buffer[x] * buffer[period + x];
 
-		for (; x < dst_next; x++) {
-			samples[x] = start;
-			start += delta;
+		if (norm > 1e-12f) {
+			corr /= sqrtf(norm);
+			if (corr > best_corr) {
+				best_corr = corr;
+				best = period;
+			}
 		}
+		if (period == limit)
+			break;
+		eb += buffer[period + corrSamples] * buffer[period + corrSamples] -
+		    buffer[period] * buffer[period];
+		if (eb < 0.0f)
+			eb = 0.0f;
 	}
 
-	/* Set new total buffer size */
-	total = to + 1;
+	ea /= corrSamples;
+
+	const bool quiet = (ea <= energy_avg);
+
+	energy_avg += (ea - energy_avg) / 8.0f;
+
+	/* wait for a good match or a quiet spot, if possible */
+	if (best_corr < 0.7f && quiet == false && ++adjust_wait < maxWait)
+		return;
+
+	doPeriod(best, drop);
+
+	adjust_wait = 0;
+	if (drop)
+		adjust_pending -= best;
+	else
+		adjust_pending += best;
 }
 
-/* remove samples from buffer, must be called periodically */
+/*
+ * Cubic Hermite interpolation in Farrow form, between the samples
+ * "x0" and "x1" at the fractional position "mu".
+ */
+static inline float
+hpsjam_farrow_cubic(float xm1, float x0, float x1, float x2, float mu)
+{
+	const float c1 = 0.5f * (x1 - xm1);
+	const float c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+	const float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+
+	return (((c3 * mu + c2) * mu + c1) * mu + x0);
+}
+
+/*
+ * Continuous drift compensation. The consumption rate is steered by
+ * a PI controller keeping the low water mark at the slack level, and
+ * the output is interpolated at the resulting fractional positions.
+ */
+void
+hpsjam_audio_buffer :: doDrift(float *left, float *right, size_t num)
+{
+	const int slack = getWaterSlack();
+
+	if (slack < 0) {
+		drift_ratio = 1.0f;
+	} else {
+		const float error = (float)low_water - (float)slack;
+		const float limit = driftMax / driftKi;
+		float ratio;
+
+		drift_integral += error;
+		if (drift_integral > limit)
+			drift_integral = limit;
+		else if (drift_integral < -limit)
+			drift_integral = -limit;
+
+		ratio = driftKp * error + driftKi * drift_integral;
+		if (ratio > driftMax)
+			ratio = driftMax;
+		else if (ratio < -driftMax)
+			ratio = -driftMax;
+		drift_ratio = 1.0f + ratio;
+	}
+
+	for (size_t x = 0; x != num; x++) {
+		/* make sure there are enough samples to interpolate */
+		if (total < 3)
+			addConcealment(fadeSamples);
+
+		const float *x0 = samples + consumer * channels;
+		const float *x1 = samples + ((consumer + 1) % HPSJAM_MAX_SAMPLES) * channels;
+		const float *x2 = samples + ((consumer + 2) % HPSJAM_MAX_SAMPLES) * channels;
+
+		float out[HPSJAM_MAX_CHANNELS];
+
+		for (unsigned ch = 0; ch != channels; ch++) {
+			out[ch] = hpsjam_farrow_cubic(drift_last[ch],
+			    x0[ch], x1[ch], x2[ch], drift_phase);
+		}
+
+		if (channels == 1) {
+			left[x] = out[0];
+			if (right != 0)
+				right[x] = out[0];
+		} else if (right != 0) {
+			left[x] = out[0];
+			right[x] = out[1];
+		} else {
+			left[x] = (out[0] + out[1]) / 2.0f;
+		}
+
+		drift_phase += drift_ratio;
+		while (drift_phase >= 1.0f) {
+			drift_phase -= 1.0f;
+			for (unsigned ch = 0; ch != channels; ch++)
+				drift_last[ch] = samples[consumer * channels + ch];
+			consumer = (consumer + 1) % HPSJAM_MAX_SAMPLES;
+			total--;
+			if (total < 3)
+				addConcealment(fadeSamples);
+		}
+	}
+}
+
+/*
+ * Remove samples from buffer, must be called periodically. A stereo
+ * buffer is downmixed into left, when right is NULL. A mono buffer
+ * copies left into right, when right is not NULL.
+ */
 void
-hpsjam_audio_buffer :: remSamples(float *dst, size_t num)
+hpsjam_audio_buffer :: remSamples(float *left, float *right, size_t num)
 {
-	size_t middle;
 	size_t fwd;
-	int missing;
 
 	doWater(num);
 
 	/* check if it is time to adjust buffer */
 	if (adjust_buffer) {
-		missing = getWaterRef();
-		middle = (high_water + low_water) / 2;
+		adjust_pending = getWaterRef();
 
-		/* only adjust when the buffer is above middle full */
-		if (total >= middle) {
-			doAdjustBuffer(missing);
-			adjust_buffer = false;
-		}
+		/* let the drift compensation handle small deviations */
+		if (hpsjam_drift_compensation &&
+		    abs(adjust_pending) < HPSJAM_MAX_SAMPLES / 4)
+			adjust_pending = 0;
+		adjust_buffer = false;
+	}
+
+	/* drop or insert one period at a time */
+	if (adjust_pending != 0)
+		doStretch();
+
+	if (hpsjam_drift_compensation) {
+		doDrift(left, right, num);
+		return;
 	}
 
 	/* copy samples from ring-buffer */
 	while (num != 0) {
 		/* if the buffer is empty, fill it with silence */
 		if (total == 0)
-			addSilence(fadeSamples);
+			addConcealment(fadeSamples);
 		/* setup forward size */
 		fwd = HPSJAM_MAX_SAMPLES - consumer;
 		if (fwd > num)
 			fwd = num;
 		if (fwd > total)
 			fwd = total;
-		memcpy(dst, samples + consumer, sizeof(samples[0]) * fwd);
-		dst += fwd;
+
+		const float *src = samples + consumer * channels;
+
+		if (channels == 1) {
+			memcpy(left, src, sizeof(left[0]) * fwd);
+			if (right != 0) {
+				memcpy(right, src, sizeof(right[0]) * fwd);
+				right += fwd;
+			}
+		} else if (right != 0) {
+			for (size_t x = 0; x != fwd; x++) {
+				left[x] = src[2 * x];
+				right[x] = src[2 * x + 1];
+			}
+			right += fwd;
+		} else {
+			/* downmix to mono */
+			for (size_t x = 0; x != fwd; x++)
+				left[x] = (src[2 * x] + src[2 * x + 1]) / 2.0f;
+		}
+		left += fwd;
 		num -= fwd;
 		consumer += fwd;
 		total -= fwd;
@@ -149,42 +443,79 @@ hpsjam_audio_buffer :: remSamples(float *dst, size_t num)
 	}
 }
 
-/* add samples to buffer */
+/*
+ * Add samples to buffer. A mono buffer takes the left samples only,
+ * or the average of both when two different channels are given. A
+ * stereo buffer duplicates the left samples, when right is NULL.
+ */
 void
-hpsjam_audio_buffer :: addSamples(const float *src, size_t num)
+hpsjam_audio_buffer :: addSamples(const float *left, const float *right, size_t num)
 {
 	size_t producer = (consumer + total) % HPSJAM_MAX_SAMPLES;
 	size_t fwd = HPSJAM_MAX_SAMPLES - producer;
 	size_t max = HPSJAM_MAX_SAMPLES - total;
+	float temp[HPSJAM_MAX_SAMPLES];
 
 	if (num > max)
 		num = max;
 
+	if (right == 0) {
+		right = left;
+	} else if (channels == 1 && right != left) {
+		/* downmix to mono */
+		for (size_t x = 0; x != num; x++)
+			temp[x] = (left[x] + right[x]) / 2.0f;
+		left = right = temp;
+	}
+
 	/* copy samples to ring-buffer */
 	while (num != 0) {
 		if (fwd > num)
 			fwd = num;
 		if (fwd != 0) {
+			float *dst = samples + producer * channels;
+
 			/* check if there was a discontinuity, and fade in audio */
 			if (fade_in != 0) {
 				for (size_t x = 0; x != fwd; x++) {
 					const float f = (float)fade_in / (float)fadeSamples;
-					const float s = ping_pong_data[(ping_pong_offset + x) % fadeSamples];
+					const float src[HPSJAM_MAX_CHANNELS] = { left[x], right[x] };
+					const float *prev = samples + ((producer + x + HPSJAM_MAX_SAMPLES -
+					    conceal_period) % HPSJAM_MAX_SAMPLES) * channels;
+
+					for (unsigned ch = 0; ch != channels; ch++) {
+						/* cross-fade from the concealment, if any */
+						const float s = conceal_period ? prev[ch] * conceal_gain :
+						    ping_pong_data[ch][(ping_pong_offset + x) % fadeSamples];
 
-					samples[producer + x] = src[x] - f * src[x] + s * f;
+						dst[x * channels + ch] = src[ch] - f * src[ch] + s * f;
+					}
 					fade_in -= (fade_in != 0);
 				}
 			} else {
-				memcpy(samples + producer, src, sizeof(samples[0]) * fwd);
+				if (channels == 1) {
+					memcpy(dst, left, sizeof(dst[0]) * fwd);
+				} else {
+					for (size_t x = 0; x != fwd; x++) {
+						dst[2 * x] = left[x];
+						dst[2 * x + 1] = right[x];
+					}
+				}
 			}
 
 			/* add all required samples to ping pong buffer */
 			for (size_t off = (fwd < fadeSamples) ? 0 : (fwd - fadeSamples); off != fwd; off++)
-				addPingPongBuffer(samples[producer + off]);
+				addPingPongBuffer(dst + off * channels);
+
+			/* concealment is complete after the fade */
+			if (fade_in == 0)
+				conceal_period = 0;
 
 			/* update last sample */
-			last_sample = samples[producer + fwd - 1];
-			src += fwd;
+			for (unsigned ch = 0; ch != channels; ch++)
+				last_sample[ch] = dst[(fwd - 1) * channels + ch];
+			left += fwd;
+			right += fwd;
 			num -= fwd;
 			total += fwd;
 			producer += fwd;
@@ -204,47 +535,215 @@ void
 hpsjam_audio_buffer :: addSilence(size_t num)
 {
 	size_t producer = (consumer + total) % HPSJAM_MAX_SAMPLES;
-	size_t fwd = HPSJAM_MAX_SAMPLES - producer;
 	size_t max = HPSJAM_MAX_SAMPLES - total;
+	float gain = 1.0f;
 
 	if (num > max)
 		num = max;
+	if (num == 0)
+		return;
 
 	/* fill missing samples with data from ping pong buffer, if any */
-	hpsjam_create_ping_pong_buffer(ping_pong_data, ping_pong_data,
-	    ping_pong_offset, fadeSamples);
+	for (unsigned ch = 0; ch != channels; ch++) {
+		hpsjam_create_ping_pong_buffer(ping_pong_data[ch], ping_pong_data[ch],
+		    ping_pong_offset, fadeSamples);
+	}
 
-	/* copy samples to ring-buffer */
-	while (num != 0) {
-		if (fwd > num)
-			fwd = num;
-		if (fwd != 0) {
-			float gain = 1.0f;
+	for (size_t x = 0; x != num; x++) {
+		float *dst = samples + producer * channels;
 
-			/* fill end of buffer using ping pong data */
-			for (size_t x = 0; x != fwd; x++) {
-				gain -= gain / (HPSJAM_SAMPLE_RATE / 8);
-				samples[producer + x] =
-				    ping_pong_data[(ping_pong_offset + x) % fadeSamples] * gain;
+		gain -= gain / (HPSJAM_SAMPLE_RATE / 8);
+
+		for (unsigned ch = 0; ch != channels; ch++) {
+			dst[ch] = ping_pong_data[ch][(ping_pong_offset + x) % fadeSamples] * gain;
+			last_sample[ch] = dst[ch];
+		}
+		if (++producer == HPSJAM_MAX_SAMPLES)
+			producer = 0;
+	}
+
+	/* update ping pong offset and gain */
+	ping_pong_offset = (ping_pong_offset + num) % fadeSamples;
+
+	for (unsigned ch = 0; ch != channels; ch++) {
+		for (size_t x = 0; x != fadeSamples; x++)
+			ping_pong_data[ch][x] *= gain;
+	}
+
+	fade_in = fadeSamples;
+	total += num;
+}
+
+/*
+ * Find the pitch period of the most recently added frames, using
+ * normalized autocorrelation over the last few milliseconds. The
+ * channels are summed for the search.
+ */
+size_t
+hpsjam_audio_buffer :: findPeriod(size_t producer) const
+{
+	enum { histSamples = maxPeriod + corrSamples };
+	float hist[histSamples];
+	const float *last = hist + histSamples - corrSamples;
+	float ea = 0.0f;
+	float eb = 0.0f;
+
+	for (size_t x = 0; x != histSamples; x++) {
+		const float *src = samples + ((producer + HPSJAM_MAX_SAMPLES - histSamples + x) %
+		    HPSJAM_MAX_SAMPLES) * channels;
+		float sum = 0.0f;
+
+		for (unsigned ch = 0; ch != channels; ch++)
+			sum += src[ch];
+		hist[x] = sum;
+	}
+
+	for (size_t x = 0; x != corrSamples; x++) {
+		ea += last[x] * last[x];
+		eb += last[x - minPeriod] * last[x - minPeriod];
+	}
+
+	float best_corr = 0.0f;
+	size_t best = minPeriod;
+
+	for (size_t period = minPeriod; ; period++) {
+		const float norm = ea * eb;
+		float corr = 0.0f;
+
+		for (size_t x = 0; x != corrSamples; x++)
+			corr += last[x] * last[x - period];
+
+		if (norm > 1e-12f) {
+			corr /= sqrtf(norm);
+			if (corr > best_corr) {
+				best_corr = corr;
+				best = period;
 			}
+		}
+		if (period == maxPeriod)
+			break;
+		eb += last[-period - 1] * last[-period - 1] -
+		    last[corrSamples - period - 1] * last[corrSamples - period - 1];
+		if (eb < 0.0f)
+			eb = 0.0f;
+	}
+	return (best);
+}
 
-			/* update ping pong offset and gain */
-			ping_pong_offset = (ping_pong_offset + fwd) % fadeSamples;
+/*
+ * Conceal lost audio by repeating the last pitch period with gradual
+ * attenuation. When the real audio resumes, addSamples() cross-fades
+ * from the continued repetition. Falls back to addSilence(), if not
+ * enabled.
+ */
+void
+hpsjam_audio_buffer :: addConcealment(size_t num)
+{
+	size_t producer = (consumer + total) % HPSJAM_MAX_SAMPLES;
+	size_t max = HPSJAM_MAX_SAMPLES - total;
 
-			for (size_t x = 0; x != fadeSamples; x++)
-				ping_pong_data[x] *= gain;
+	if (conceal == false) {
+		addSilence(num);
+		return;
+	}
 
-			/* update last sample */
-			last_sample = samples[producer + fwd - 1];
+	if (num > max)
+		num = max;
+	if (num == 0)
+		return;
 
-			fade_in = fadeSamples;
-			num -= fwd;
-			total += fwd;
-			producer += fwd;
+	/* figure out the period once per loss */
+	if (conceal_period == 0) {
+		conceal_period = findPeriod(producer);
+		conceal_decay = powf(concealDecay, conceal_period);
+		conceal_gain = 1.0f;
+	}
+
+	for (size_t x = 0; x != num; x++) {
+		float *dst = samples + producer * channels;
+		const float *src = samples + ((producer + HPSJAM_MAX_SAMPLES - conceal_period) %
+		    HPSJAM_MAX_SAMPLES) * channels;
+
+		/* ramp the attenuation in during the first period */
+		if (conceal_gain > conceal_decay)
+			conceal_gain *= concealDecay;
+
+		for (unsigned ch = 0; ch != channels; ch++) {
+			dst[ch] = src[ch] * conceal_gain;
+			last_sample[ch] = dst[ch];
 		}
-		if (producer == HPSJAM_MAX_SAMPLES) {
-			producer = 0;
-			fwd = HPSJAM_MAX_SAMPLES;
+		addPingPongBuffer(dst);
+		producer = (producer + 1) % HPSJAM_MAX_SAMPLES;
+	}
+
+	fade_in = fadeSamples;
+	total += num;
+}
+
+/*
+ * Polyphase filter for 4x oversampling, using a Hann windowed sinc.
+ * Phase zero is the sample itself and is not computed.
+ */
+struct hpsjam_true_peak_filter {
+	float coeff[HPSJAM_TRUE_PEAK_PHASES - 1][HPSJAM_TRUE_PEAK_TAPS];
+
+	hpsjam_true_peak_filter() {
+		constexpr float half = HPSJAM_TRUE_PEAK_TAPS / 2;
+
+		for (unsigned p = 1; p != HPSJAM_TRUE_PEAK_PHASES; p++) {
+			float sum = 0;
+
+			for (unsigned k = 0; k != HPSJAM_TRUE_PEAK_TAPS; k++) {
+				const float t = (float)k - (half - 1.0f) -
+				    (float)p / HPSJAM_TRUE_PEAK_PHASES;
+				const float w = 0.5f + 0.5f * cosf(M_PI * t / half);
+				const float v = w * sinf(M_PI * t) / (M_PI * t);
+
+				coeff[p - 1][k] = v;
+				sum += v;
+			}
+			for (unsigned k = 0; k != HPSJAM_TRUE_PEAK_TAPS; k++)
+				coeff[p - 1][k] /= sum;
+		}
+	};
+};
+
+static const struct hpsjam_true_peak_filter hpsjam_true_peak_filter;
+
+/*
+ * Return the peak of the interpolated samples. The result is delayed
+ * by half the filter length, which does not matter for metering.
+ */
+float
+hpsjam_audio_level :: getTruePeak(const float *ptr, size_t num)
+{
+	constexpr size_t hsize = HPSJAM_TRUE_PEAK_TAPS - 1;
+	constexpr size_t chunk = 64;
+	float buffer[hsize + chunk];
+	float peak = 0;
+
+	memcpy(buffer, history, sizeof(history));
+
+	while (num != 0) {
+		const size_t delta = (num > chunk) ? chunk : num;
+
+		memcpy(buffer + hsize, ptr, delta * sizeof(buffer[0]));
+
+		for (unsigned p = 0; p != HPSJAM_TRUE_PEAK_PHASES - 1; p++) {
+			const float *coeff = hpsjam_true_peak_filter.coeff[p];
+
+			for (size_t x = 0; x < delta; x++) {
+				float sum = 0;
+				for (unsigned k = 0; k != HPSJAM_TRUE_PEAK_TAPS; k++)
+					sum += buffer[x + k] * coeff[k];
+				sum = fabsf(sum);
+				peak = (sum > peak) ? sum : peak;
+			}
 		}
+		memmove(buffer, buffer + delta, hsize * sizeof(buffer[0]));
+		ptr += delta;
+		num -= delta;
 	}
+	memcpy(history, buffer, sizeof(history));
+	return (peak);
 }
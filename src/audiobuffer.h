@@ -28,12 +28,14 @@
 
 #include <math.h>
 #include <assert.h>
+#include <string.h>
 
 #include "hpsjam.h"
 #include "protocol.h"
 
 #define	HPSJAM_MAX_SAMPLES \
 	(32 * HPSJAM_DEF_SAMPLES) /* 32 ms */
+#define	HPSJAM_MAX_CHANNELS 2
 
 static inline float
 level_encode(float value)
@@ -61,82 +63,195 @@ level_decode(float value)
 		return multiplier * (powf(1.0f + 255.0f, value) - 1.0f);
 }
 
+#define	HPSJAM_TRUE_PEAK_TAPS 8	/* per phase */
+#define	HPSJAM_TRUE_PEAK_PHASES 4	/* oversampling factor */
+#define	HPSJAM_LEVEL_LANES 8
+
+/*
+ * Compute the peak value and accumulate the sum of squares. The
+ * samples are processed in independent lanes, so that the compiler
+ * can vectorize both reductions. The peak is computed from the bit
+ * pattern of the absolute value, like in hpsjam_block_peak().
+ */
+static inline float
+hpsjam_level_scan(const float *ptr, size_t num, float &power)
+{
+	uint32_t peak[HPSJAM_LEVEL_LANES] = {};
+	float sum[HPSJAM_LEVEL_LANES] = {};
+	float retval;
+	size_t x;
+
+	for (x = 0; x + HPSJAM_LEVEL_LANES <= num; x += HPSJAM_LEVEL_LANES) {
+		for (unsigned y = 0; y != HPSJAM_LEVEL_LANES; y++) {
+			uint32_t v;
+			memcpy(&v, ptr + x + y, sizeof(v));
+			v &= 0x7fffffffU;
+			peak[y] = (v > peak[y]) ? v : peak[y];
+			sum[y] += ptr[x + y] * ptr[x + y];
+		}
+	}
+	for (unsigned y = 0; x < num; x++, y++) {
+		uint32_t v;
+		memcpy(&v, ptr + x, sizeof(v));
+		v &= 0x7fffffffU;
+		peak[y] = (v > peak[y]) ? v : peak[y];
+		sum[y] += ptr[x] * ptr[x];
+	}
+	for (unsigned y = 1; y != HPSJAM_LEVEL_LANES; y++) {
+		peak[0] = (peak[y] > peak[0]) ? peak[y] : peak[0];
+		sum[0] += sum[y];
+	}
+	power += sum[0];
+	memcpy(&retval, peak, sizeof(retval));
+	return (retval);
+}
+
 class hpsjam_audio_level {
+	/* limit the RMS window, when nobody reads the level */
+	enum { maxCount = 1U << 20 };
 public:
-	float level;
+	float level;	/* decaying peak */
+	float power;	/* sum of squares */
+	uint32_t count;	/* samples in power */
+	float history[HPSJAM_TRUE_PEAK_TAPS - 1];
 
 	hpsjam_audio_level() {
 		clear();
 	};
 	void clear() {
 		level = 0;
+		power = 0;
+		count = 0;
+		memset(history, 0, sizeof(history));
 	};
 	void addSamples(const float *ptr, size_t num) {
-		for (size_t x = 0; x != num; x++) {
-			const float v = fabsf(ptr[x]);
-			if (v > level)
-				level = v;
+		float peak = hpsjam_level_scan(ptr, num, power);
+
+		if (hpsjam_true_peak_meter) {
+			const float temp = getTruePeak(ptr, num);
+			if (temp > peak)
+				peak = temp;
 		}
-		if (level > 1.0f)
+		if (peak > level)
+			level = peak;
+		if (!(level <= 1.0f))
 			level = 1.0f;
+
+		count += num;
+		if (count > maxCount) {
+			power /= 2.0f;
+			count /= 2;
+		}
 	};
 	float getLevel() {
 		float retval = level;
 		level = retval / 2.0f;
 		return (retval);
 	};
+	float getRMS() {
+		float retval = count ? sqrtf(power / count) : 0.0f;
+		power = 0;
+		count = 0;
+		if (!(retval <= 1.0f))
+			retval = 1.0f;
+		return (retval);
+	};
+	float getTruePeak(const float *, size_t);
 };
 
+/*
+ * Ring buffer of mono or stereo audio frames, stored interleaved.
+ * All bookkeeping is shared by the channels, so that they always
+ * stay sample aligned.
+ */
 class hpsjam_audio_buffer {
 	enum { fadeSamples = HPSJAM_DEF_SAMPLES };
+	/* pitch period search range, 100Hz .. 1kHz */
+	enum { minPeriod = HPSJAM_DEF_SAMPLES };
+	enum { maxPeriod = 10 * HPSJAM_DEF_SAMPLES };
+	enum { corrSamples = 2 * HPSJAM_DEF_SAMPLES };
+	enum { maxWait = 64 };	/* calls */
+	/* drift compensation limits */
+	static constexpr float driftMax = 0.002f;	/* 2000 ppm */
+	static constexpr float driftKp = 0.00002f;
+	static constexpr float driftKi = 0.00000001f;
+	/* packet loss concealment attenuation, per sample */
+	static constexpr float concealDecay = 0.9995f;
 public:
 	enum {
 		WATER_LOW = 0,
 		WATER_NORMAL = 1,
 		WATER_HIGH = 2,
-		WATER_MAX = 32,
+		WATER_MAX = 64,	/* buckets */
+		WATER_DEF = 32,	/* water levels */
+	};
+	struct hpsjam_water_entry {
+		uint32_t index;
+		uint16_t value;
 	};
-	float samples[HPSJAM_MAX_SAMPLES];
-	float ping_pong_data[fadeSamples];
-	float last_sample;
-	size_t consumer;
-	size_t total;
+	float samples[HPSJAM_MAX_SAMPLES * HPSJAM_MAX_CHANNELS];
+	float ping_pong_data[HPSJAM_MAX_CHANNELS][fadeSamples];
+	float last_sample[HPSJAM_MAX_CHANNELS];
+	size_t consumer;	/* frames */
+	size_t total;	/* frames */
+	uint8_t channels;
 	uint16_t fade_in;
 	uint16_t ping_pong_offset;
 	uint16_t target_water;
-	uint16_t water_index;
-	uint16_t last_water[WATER_MAX];
+	/* monotonic queues of bucket minimums and maximums */
+	struct hpsjam_water_entry water_min[WATER_MAX];
+	struct hpsjam_water_entry water_max[WATER_MAX];
+	uint32_t water_index;
+	uint16_t water_min_head;
+	uint16_t water_min_count;
+	uint16_t water_max_head;
+	uint16_t water_max_count;
+	uint16_t water_buckets;
+	uint16_t water_bucket_size;
+	uint16_t water_fill;
+	uint16_t water_last;
+	uint16_t bucket_low;
+	uint16_t bucket_high;
 	uint16_t high_water;
 	uint16_t low_water;
+	uint16_t adjust_wait;
+	uint16_t conceal_period;
+	int adjust_pending;
+	float energy_avg;
+	float drift_ratio;
+	float drift_phase;
+	float drift_integral;
+	float drift_last[HPSJAM_MAX_CHANNELS];
+	float conceal_decay;	/* attenuation per period */
+	float conceal_gain;	/* attenuation relative to one period ago */
 	bool adjust_buffer;
+	bool conceal;
 
 	void addWater(uint16_t level) {
-		uint16_t &previous = last_water[water_index % WATER_MAX];
-		bool recompute = (previous == low_water || previous == high_water);
-		previous = level;
-		water_index++;
-
-		/* only recompute water levels when really needed */
-		if (recompute) {
-			low_water = HPSJAM_MAX_SAMPLES;
-			high_water = 0;
-
-			for (unsigned x = 0; x != WATER_MAX; x++) {
-				if (low_water > last_water[x])
-					low_water = last_water[x];
-				if (high_water < last_water[x])
-					high_water = last_water[x];
-			}
-		} else {
-			if (low_water > level)
-				low_water = level;
-			else if (high_water < level)
-				high_water = level;
-		}
+		water_last = level;
+
+		if (bucket_low > level)
+			bucket_low = level;
+		if (bucket_high < level)
+			bucket_high = level;
+
+		if (++water_fill == water_bucket_size)
+			addWaterBucket();
+
+		/* combine the sliding window with the current bucket */
+		low_water = bucket_low;
+		high_water = bucket_high;
+
+		if (water_min_count != 0 &&
+		    low_water > water_min[water_min_head].value)
+			low_water = water_min[water_min_head].value;
+		if (water_max_count != 0 &&
+		    high_water < water_max[water_max_head].value)
+			high_water = water_max[water_max_head].value;
 	};
 
 	void doWater(size_t num) {
-		if (last_water[(water_index + WATER_MAX - 1) % WATER_MAX] != total)
+		if (water_last != total)
 			addWater(total);
 		if (num > total)
 			addWater(0);
@@ -144,30 +259,70 @@ public:
 			addWater(total - num);
 	};
 
+	void clearWater() {
+		water_index = 0;
+		water_min_head = 0;
+		water_min_count = 0;
+		water_max_head = 0;
+		water_max_count = 0;
+		water_fill = 0;
+		water_last = 0;
+		bucket_low = HPSJAM_MAX_SAMPLES;
+		bucket_high = 0;
+		high_water = 0;
+		low_water = HPSJAM_MAX_SAMPLES;
+	};
+
+	/* set the number of water levels to track, two per tick typically */
+	void setWaterWindow(unsigned levels) {
+		if (levels == 0)
+			levels = 1;
+		water_bucket_size = (levels + WATER_MAX - 2) / (WATER_MAX - 1);
+		water_buckets = (levels + water_bucket_size - 1) / water_bucket_size;
+		clearWater();
+	};
+
 	void clear() {
 		memset(samples, 0, sizeof(samples));
 		memset(ping_pong_data, 0, sizeof(ping_pong_data));
 		ping_pong_offset = 0;
-		last_sample = 0;
+		memset(last_sample, 0, sizeof(last_sample));
 		consumer = 0;
 		total = 0;
 		fade_in = fadeSamples;
-		memset(last_water, 0, sizeof(last_water));
-		water_index = 0;
-		high_water = 0;
-		low_water = HPSJAM_MAX_SAMPLES;
+		clearWater();
+		adjust_wait = 0;
+		adjust_pending = 0;
+		energy_avg = 0;
+		drift_ratio = 1.0f;
+		drift_phase = 0;
+		drift_integral = 0;
+		memset(drift_last, 0, sizeof(drift_last));
+		conceal_decay = 1.0f;
+		conceal_gain = 1.0f;
+		conceal_period = 0;
 		adjust_buffer = false;
 	};
 
-	void addPingPongBuffer(float sample) {
-		ping_pong_data[ping_pong_offset] = sample;
+	void addPingPongBuffer(const float *frame) {
+		for (unsigned ch = 0; ch != channels; ch++)
+			ping_pong_data[ch][ping_pong_offset] = frame[ch];
 		if (++ping_pong_offset == fadeSamples)
 			ping_pong_offset = 0;
 	};
 
 	hpsjam_audio_buffer() {
+		channels = HPSJAM_MAX_CHANNELS;
+		setWaterWindow(hpsjam_water_window ?
+		    2 * hpsjam_water_window : WATER_DEF);
 		clear();
 		target_water = HPSJAM_MAX_SAMPLES / 2;
+		conceal = false;
+	};
+
+	/* select between pitch based concealment and fading silence */
+	void setConcealment(bool enable) {
+		conceal = enable;
 	};
 
 	int setWaterTarget(int value) {
@@ -177,7 +332,9 @@ public:
 		/* range check */
 		if (value > (HPSJAM_MAX_SAMPLES / 2))
 			value = HPSJAM_MAX_SAMPLES / 2;
-		else if (value < (4 * HPSJAM_DEF_SAMPLES))
+		else if (value < (2 * HPSJAM_DEF_SAMPLES) && hpsjam_drift_compensation)
+			value = 2 * HPSJAM_DEF_SAMPLES;
+		else if (value < (4 * HPSJAM_DEF_SAMPLES) && !hpsjam_drift_compensation)
 			value = 4 * HPSJAM_DEF_SAMPLES;
 		/* set new value */
 		target_water = value;
@@ -185,17 +342,23 @@ public:
 		return (value / HPSJAM_DEF_SAMPLES);
 	};
 
-	int getWaterRef() const {
+	int getWaterSlack() const {
 		int slack = high_water - low_water;
 		if (slack < 0)
-			return (0);	/* not ready */
+			return (-1);	/* not ready */
 
 		/* limit slack by target_water */
 		if (slack < target_water)
 			slack = target_water;
 
 		/* use a half buffer length for slack */
-		slack /= 2;
+		return (slack / 2);
+	};
+
+	int getWaterRef() const {
+		const int slack = getWaterSlack();
+		if (slack < 0)
+			return (0);	/* not ready */
 
 		if (low_water < slack) {
 			int max_adjust = high_water - HPSJAM_MAX_SAMPLES;
@@ -219,17 +382,10 @@ public:
 	};
 
 	uint8_t getLowWater() const {
-		int slack = high_water - low_water;
+		const int slack = getWaterSlack();
 		if (slack < 0)
 			return (WATER_NORMAL);	/* not ready */
 
-		/* limit slack by target_water */
-		if (slack < target_water)
-			slack = target_water;
-
-		/* use a half buffer length for slack */
-		slack /= 2;
-
 		if (low_water < slack + HPSJAM_DEF_SAMPLES)
 			return (WATER_LOW);
 		else if (low_water > 3 * slack + HPSJAM_DEF_SAMPLES)
@@ -241,10 +397,18 @@ public:
 	void adjustBuffer() {
 		adjust_buffer = true;
 	};
-	void doAdjustBuffer(int);
-	void remSamples(float *, size_t);
-	void addSamples(const float *, size_t);
+	void copyFront(float *, size_t) const;
+	void writeFront(const float *, size_t);
+	void doPeriod(size_t, bool);
+	void doStretch();
+	void doDrift(float *, float *, size_t);
+	void addWaterBucket();
+	void setChannels(unsigned);
+	void remSamples(float *, float *, size_t);
+	void addSamples(const float *, const float *, size_t);
 	void addSilence(size_t);
+	size_t findPeriod(size_t) const;
+	void addConcealment(size_t);
 };
 
 #endif		/* _HPSJAM_AUDIOBUFFER_H_ */
@@ -54,8 +54,8 @@ HpsJamChatLyrics :: handle_send_lyrics()
 
 	/* send text */
 	pkt = new struct hpsjam_packet_entry;
-	pkt->packet.setRawData(temp.constData(), temp.length());
-	pkt->packet.type = HPSJAM_TYPE_LYRICS_REQUEST;
+	pkt->data->packet.setRawData(temp.constData(), temp.length());
+	pkt->data->packet.type = HPSJAM_TYPE_LYRICS_REQUEST;
 	pkt->insert_tail(&hpsjam_client_peer->output_pkt.head);
 }
 
@@ -75,8 +75,8 @@ HpsJamChatBox :: handle_send_chat()
 
 	/* send text */
 	pkt = new struct hpsjam_packet_entry;
-	pkt->packet.setRawData(temp.constData(), temp.length());
-	pkt->packet.type = HPSJAM_TYPE_CHAT_REQUEST;
+	pkt->data->packet.setRawData(temp.constData(), temp.length());
+	pkt->data->packet.type = HPSJAM_TYPE_CHAT_REQUEST;
 	pkt->insert_tail(&hpsjam_client_peer->output_pkt.head);
 }
 
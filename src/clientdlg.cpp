@@ -106,6 +106,8 @@ HpsJamClient :: HpsJamClient() : gl(this), b_connect(tr("S&ERVER")),
 	/* connect client signals */
 	connect(hpsjam_client_peer, SIGNAL(receivedFaderLevel(uint8_t,uint8_t,float,float)),
 		w_mixer, SLOT(handle_fader_level(uint8_t,uint8_t,float,float)));
+	connect(hpsjam_client_peer, SIGNAL(receivedFaderRMS(uint8_t,uint8_t,float,float)),
+		w_mixer, SLOT(handle_fader_rms(uint8_t,uint8_t,float,float)));
 	connect(hpsjam_client_peer, SIGNAL(receivedFaderGain(uint8_t,uint8_t,float)),
 		w_mixer, SLOT(handle_fader_gain(uint8_t,uint8_t,float)));
 	connect(hpsjam_client_peer, SIGNAL(receivedFaderPan(uint8_t,uint8_t,float)),
@@ -184,12 +186,14 @@ HpsJamClient :: handle_help()
 void
 HpsJamClient :: handle_watchdog()
 {
-	float temp[2];
+	float temp[4];
 
 	if (1) {
 		QMutexLocker locker(&hpsjam_client_peer->lock);
 		temp[0] = hpsjam_client_peer->out_level[0].getLevel();
 		temp[1] = hpsjam_client_peer->out_level[1].getLevel();
+		temp[2] = hpsjam_client_peer->out_level[0].getRMS();
+		temp[3] = hpsjam_client_peer->out_level[1].getRMS();
 
 		hpsjam_client_peer->bits = w_mixer->self_strip.getBits();
 		const float mg[2] = {
@@ -203,6 +207,7 @@ HpsJamClient :: handle_watchdog()
 	}
 
 	w_mixer->self_strip.w_slider.setLevel(level_encode(temp[0]), level_encode(temp[1]));
+	w_mixer->self_strip.w_slider.setRMS(level_encode(temp[2]), level_encode(temp[3]));
 }
 
 void
@@ -24,3 +24,55 @@
  */
 
 #include "compressor.h"
+
+void
+hpsjam_limiter :: doit(const float div, float *l, float *r, size_t num)
+{
+	constexpr float __limit = 1.0f - (1.0f / 10.0f);
+	constexpr size_t __delay = HPSJAM_COMPRESSOR_BLOCK;
+	float temp[2][2 * __delay];
+	float * const ptr[2] = { l, r };
+	const unsigned channels = (r != 0) ? 2 : 1;
+
+	/* sanity checks */
+	if (!hpsjam_float_is_valid(pv))
+		pv = 0.0f;
+	if (!hpsjam_float_is_valid(gain))
+		gain = 1.0f;
+
+	for (size_t off = 0; off != num; ) {
+		const size_t delta = (num - off > __delay) ? __delay : (num - off);
+		float peak;
+
+		/* shift the new samples through the delay line */
+		for (unsigned ch = 0; ch != channels; ch++) {
+			memcpy(temp[ch], delay[ch], sizeof(delay[ch]));
+			memcpy(temp[ch] + __delay, ptr[ch] + off, sizeof(float) * delta);
+			memcpy(delay[ch], temp[ch] + delta, sizeof(delay[ch]));
+		}
+
+		/* get the peak of the output and the delayed samples */
+		peak = hpsjam_block_peak(temp[0],
+		    (channels == 2) ? temp[1] : 0, __delay + delta);
+		if (peak > pv)
+			pv = peak;
+
+		/*
+		 * Ramp the gain. Both end points are below the level
+		 * required by the samples being output, because these
+		 * were part of the peak computation for both.
+		 */
+		const float target = (pv > __limit) ? (__limit / pv) : 1.0f;
+		const float step = (target - gain) / delta;
+
+		for (unsigned ch = 0; ch != channels; ch++) {
+			for (size_t x = 0; x != delta; x++)
+				ptr[ch][off + x] = temp[ch][x] * (gain + step * (x + 1));
+		}
+		gain = target;
+
+		if (pv > __limit)
+			pv -= (pv * delta) / div;
+		off += delta;
+	}
+}
@@ -26,6 +26,13 @@
 #ifndef _HPSJAM_COMPRESSOR_H_
 #define	_HPSJAM_COMPRESSOR_H_
 
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* samples per gain computation in the block compressor, 0.5ms */
+#define	HPSJAM_COMPRESSOR_BLOCK 24
+
 static inline bool
 hpsjam_float_is_valid(const float x)
 {
@@ -97,4 +104,115 @@ hpsjam_mono_compressor(const float div, float &pv, float &l)
 	}
 }
 
+/*
+ * Replace invalid samples by zero and return the absolute peak
+ * value. The right channel is optional. The loops are kept simple,
+ * so that the compiler can vectorize them. The peak is computed on
+ * the bit pattern of the absolute value, because integer maximum,
+ * unlike floating point maximum, does not depend on the evaluation
+ * order.
+ */
+static inline float
+hpsjam_block_peak(float *l, float *r, size_t num)
+{
+	uint32_t peak = 0;
+	float retval;
+
+	for (size_t x = 0; x < num; x++) {
+		const float v = l[x];
+		l[x] = hpsjam_float_is_valid(v) ? v : 0.0f;
+	}
+	for (size_t x = 0; x < num; x++) {
+		uint32_t v;
+		memcpy(&v, l + x, sizeof(v));
+		v &= 0x7fffffffU;
+		peak = (v > peak) ? v : peak;
+	}
+	if (r != 0) {
+		for (size_t x = 0; x < num; x++) {
+			const float v = r[x];
+			r[x] = hpsjam_float_is_valid(v) ? v : 0.0f;
+		}
+		for (size_t x = 0; x < num; x++) {
+			uint32_t v;
+			memcpy(&v, r + x, sizeof(v));
+			v &= 0x7fffffffU;
+			peak = (v > peak) ? v : peak;
+		}
+	}
+	memcpy(&retval, &peak, sizeof(retval));
+	return (retval);
+}
+
+static inline void
+hpsjam_block_gain(float *l, float *r, float gain, size_t num)
+{
+	for (size_t x = 0; x < num; x++)
+		l[x] *= gain;
+	if (r != 0) {
+		for (size_t x = 0; x < num; x++)
+			r[x] *= gain;
+	}
+}
+
+static inline void
+hpsjam_block_compressor_sub(const float div, float &pv, float *l, float *r, size_t num)
+{
+	constexpr float __limit = 1.0f - (1.0f / 10.0f);
+
+	const float peak = hpsjam_block_peak(l, r, num);
+
+	if (peak > pv)
+		pv = peak;
+	if (pv > __limit) {
+		hpsjam_block_gain(l, r, __limit / pv, num);
+		pv -= (pv * num) / div;
+	}
+}
+
+/*
+ * Block version of the compressors above. The right channel is
+ * optional. The gain is computed once every HPSJAM_COMPRESSOR_BLOCK
+ * samples, from the peak value of those samples.
+ */
+static inline void
+hpsjam_block_compressor(const float div, float &pv, float *l, float *r, size_t num)
+{
+	/* sanity checks */
+	if (!hpsjam_float_is_valid(pv))
+		pv = 0.0;
+
+	while (num >= HPSJAM_COMPRESSOR_BLOCK) {
+		hpsjam_block_compressor_sub(div, pv, l, r, HPSJAM_COMPRESSOR_BLOCK);
+		l += HPSJAM_COMPRESSOR_BLOCK;
+		if (r != 0)
+			r += HPSJAM_COMPRESSOR_BLOCK;
+		num -= HPSJAM_COMPRESSOR_BLOCK;
+	}
+	if (num != 0)
+		hpsjam_block_compressor_sub(div, pv, l, r, num);
+}
+
+/*
+ * Block compressor delaying the audio by HPSJAM_COMPRESSOR_BLOCK
+ * samples. The gain is ramped towards the level required by the
+ * delayed samples, before they reach the output.
+ */
+class hpsjam_limiter {
+public:
+	float delay[2][HPSJAM_COMPRESSOR_BLOCK];
+	float pv;
+	float gain;
+
+	hpsjam_limiter() {
+		clear();
+	};
+	void clear() {
+		memset(delay, 0, sizeof(delay));
+		pv = 0.0f;
+		gain = 1.0f;
+	};
+	void doit(const float, float *, float *, size_t);
+};
+
 #endif		/* _HPSJAM_COMPRESSOR_H_ */
@@ -191,31 +191,29 @@ HpsJamDeviceSelection :: handle_toggle_buffer_samples(int value)
 void
 HpsJamDeviceSelection :: handle_set_input_jitter(int value)
 {
-	int temp[2];
+	int temp;
 
 	do {
 		QMutexLocker locker(&hpsjam_client_peer->lock);
-		temp[0] = hpsjam_client_peer->out_audio[0].setWaterTarget(value);
-		temp[1] = hpsjam_client_peer->out_audio[1].setWaterTarget(value);
+		temp = hpsjam_client_peer->out_audio.setWaterTarget(value);
 	} while (0);
 
-	if (temp[0] != value || temp[1] != value)
-		HPSJAM_NO_SIGNAL(s_jitter_input,setValue(temp[0]));
+	if (temp != value)
+		HPSJAM_NO_SIGNAL(s_jitter_input,setValue(temp));
 }
 
 void
 HpsJamDeviceSelection :: handle_set_output_jitter(int value)
 {
-	int temp[2];
+	int temp;
 
 	do {
 		QMutexLocker locker(&hpsjam_client_peer->lock);
-		temp[0] = hpsjam_client_peer->in_audio[0].setWaterTarget(value);
-		temp[1] = hpsjam_client_peer->in_audio[1].setWaterTarget(value);
+		temp = hpsjam_client_peer->in_audio.setWaterTarget(value);
 	} while (0);
 
-	if (temp[0] != value || temp[1] != value)
-		HPSJAM_NO_SIGNAL(s_jitter_output,setValue(temp[0]));
+	if (temp != value)
+		HPSJAM_NO_SIGNAL(s_jitter_output,setValue(temp));
 }
 
 void
@@ -299,8 +297,8 @@ HpsJamConfig :: handle_down_config()
 
 	if (hpsjam_client_peer->address[0].valid()) {
 		struct hpsjam_packet_entry *pkt = new struct hpsjam_packet_entry;
-		pkt->packet.setConfigure(down_fmt.format);
-		pkt->packet.type = HPSJAM_TYPE_CONFIGURE_REQUEST;
+		pkt->data->packet.setConfigure(down_fmt.format);
+		pkt->data->packet.type = HPSJAM_TYPE_CONFIGURE_REQUEST;
 		pkt->insert_tail(&hpsjam_client_peer->output_pkt.head);
 	}
 }
@@ -286,28 +286,30 @@ HpsJamConnect :: handle_connect()
 
 	/* send initial ping */
 	pkt = new struct hpsjam_packet_entry;
-	pkt->packet.setPing(0, hpsjam_ticks, key,
-	    multiPort ? HPSJAM_FEATURE_MULTI_PORT : 0);
-	pkt->packet.type = HPSJAM_TYPE_PING_REQUEST;
+	pkt->data->packet.setPing(0, hpsjam_ticks, key, HPSJAM_FEATURE_TELEMETRY |
+	    (multiPort ? HPSJAM_FEATURE_MULTI_PORT : 0) |
+	    HPSJAM_FEATURE_LEVEL_RMS |
+	    (hpsjam_loss_concealment ? HPSJAM_FEATURE_CONCEALMENT : 0));
+	pkt->data->packet.type = HPSJAM_TYPE_PING_REQUEST;
 	pkt->insert_tail(&hpsjam_client_peer->output_pkt.head);
 
 	/* send initial configuration */
 	pkt = new struct hpsjam_packet_entry;
-	pkt->packet.setConfigure(hpsjam_client->w_config->down_fmt.format);
-	pkt->packet.type = HPSJAM_TYPE_CONFIGURE_REQUEST;
+	pkt->data->packet.setConfigure(hpsjam_client->w_config->down_fmt.format);
+	pkt->data->packet.type = HPSJAM_TYPE_CONFIGURE_REQUEST;
 	pkt->insert_tail(&hpsjam_client_peer->output_pkt.head);
 
 	/* send name */
 	temp = nick.toUtf8();
 	pkt = new struct hpsjam_packet_entry;
-	pkt->packet.setRawData(temp.constData(), temp.length());
-	pkt->packet.type = HPSJAM_TYPE_NAME_REQUEST;
+	pkt->data->packet.setRawData(temp.constData(), temp.length());
+	pkt->data->packet.type = HPSJAM_TYPE_NAME_REQUEST;
 	pkt->insert_tail(&hpsjam_client_peer->output_pkt.head);
 
 	/* send icon */
 	pkt = new struct hpsjam_packet_entry;
-	pkt->packet.setRawData(idata.constData(), idata.length(), ' ');
-	pkt->packet.type = HPSJAM_TYPE_ICON_REQUEST;
+	pkt->data->packet.setRawData(idata.constData(), idata.length(), ' ');
+	pkt->data->packet.type = HPSJAM_TYPE_ICON_REQUEST;
 	pkt->insert_tail(&hpsjam_client_peer->output_pkt.head);
 
 	/* set local format, nickname and icon */
@@ -0,0 +1,105 @@
+/*-
+ * Copyright (c) 2022 Hans Petter Selasky. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	_HPSJAM_DENORMAL_H_
+#define	_HPSJAM_DENORMAL_H_
+
+#include <stdint.h>
+
+/*
+ * Arithmetic on subnormal floating point numbers is very slow on
+ * many CPUs. Signals and filter states decaying towards zero end up
+ * there all the time, so the real-time threads flush them to zero.
+ */
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define	HPSJAM_FP_FLUSH 0x8040U		/* FTZ and DAZ */
+#elif defined(__aarch64__)
+#define	HPSJAM_FP_FLUSH (1U << 24)	/* FZ */
+#elif defined(__arm__) && defined(__ARM_FP)
+#define	HPSJAM_FP_FLUSH (1U << 24)	/* FZ */
+#else
+#define	HPSJAM_FP_FLUSH 0U
+#endif
+
+static inline uintptr_t
+hpsjam_fp_mode_get()
+{
+	uintptr_t retval;
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	retval = _mm_getcsr();
+#elif defined(__aarch64__)
+	uint64_t temp;
+	__asm__ __volatile__("mrs %0, fpcr" : "=r" (temp));
+	retval = temp;
+#elif defined(__arm__) && defined(__ARM_FP)
+	uint32_t temp;
+	__asm__ __volatile__("vmrs %0, fpscr" : "=r" (temp));
+	retval = temp;
+#else
+	retval = 0;
+#endif
+	return (retval);
+}
+
+static inline void
+hpsjam_fp_mode_set(uintptr_t mode)
+{
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	_mm_setcsr(mode);
+#elif defined(__aarch64__)
+	const uint64_t temp = mode;
+	__asm__ __volatile__("msr fpcr, %0" : : "r" (temp));
+#elif defined(__arm__) && defined(__ARM_FP)
+	const uint32_t temp = mode;
+	__asm__ __volatile__("vmsr fpscr, %0" : : "r" (temp));
+#else
+	(void)mode;
+#endif
+}
+
+/* for threads owned by HPSJAM */
+static inline void
+hpsjam_denormal_disable()
+{
+	hpsjam_fp_mode_set(hpsjam_fp_mode_get() | HPSJAM_FP_FLUSH);
+}
+
+/* for callbacks running on threads owned by the audio API */
+class hpsjam_denormal_guard {
+	const uintptr_t mode;
+public:
+	hpsjam_denormal_guard() : mode(hpsjam_fp_mode_get()) {
+		if ((mode & HPSJAM_FP_FLUSH) != HPSJAM_FP_FLUSH)
+			hpsjam_fp_mode_set(mode | HPSJAM_FP_FLUSH);
+	};
+	~hpsjam_denormal_guard() {
+		if ((mode & HPSJAM_FP_FLUSH) != HPSJAM_FP_FLUSH)
+			hpsjam_fp_mode_set(mode);
+	};
+};
+
+#endif		/* _HPSJAM_DENORMAL_H_ */
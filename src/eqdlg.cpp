@@ -169,7 +169,7 @@ HpsJamEqualizer :: handle_longdelay()
 	if (1) {
 		QMutexLocker locker(&hpsjam_client_peer->lock);
 		rtt_ms = hpsjam_client_peer->output_pkt.ping_time +
-		    hpsjam_client_peer->input_pkt.jitter.get_jitter_in_ms();
+		    hpsjam_client_peer->input_pkt->jitter.get_jitter_in_ms();
 	}
 
 	edit.setText(QString(
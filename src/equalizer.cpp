@@ -26,14 +26,32 @@
  */
 
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <err.h>
 #include <kiss_fft.h>
 #include <math.h>
 
+#include <QMutex>
+
 #include "hpsjam.h"
 #include "multiply.h"
 #include "equalizer.h"
 
+/*
+ * Partition size of the frequency domain convolution. Filters
+ * longer than this are split into partitions of this size, so
+ * that the latency and the work per call stays constant.
+ */
+#define	HPSJAM_EQ_PARTITION HPSJAM_DEF_SAMPLES
+#define	HPSJAM_EQ_BINS (HPSJAM_EQ_PARTITION + 1)
+
+/* crossfade length when switching filters, 10ms */
+#define	HPSJAM_EQ_FADE (10 * HPSJAM_DEF_SAMPLES)
+#define	HPSJAM_EQ_POLL 5000	/* us, worker queue polling */
+
 static void
 hpsjam_skip_space(const char **pp, bool newline)
 {
@@ -213,9 +231,178 @@ struct equalizer {
 	};
 };
 
+/*
+ * Immutable filter design. Designs are shared between equalizers
+ * using the same configuration, through the design cache.
+ */
+class hpsjam_equalizer_design {
+public:
+	TAILQ_ENTRY(hpsjam_equalizer_design) entry;
+	std::atomic<unsigned> refs;
+	char *key;
+	size_t filter_size;
+	size_t filter_predelay;
+	size_t part_count;
+	float *filter_data;
+	kiss_fft_cpx *part_filter;
+};
+
+/* maximum number of cached filter designs */
+#define	HPSJAM_EQ_CACHE_MAX 16
+
+static QMutex hpsjam_eq_cache_mtx;
+static TAILQ_HEAD(hpsjam_equalizer_design_head, hpsjam_equalizer_design) hpsjam_eq_cache_head =
+    TAILQ_HEAD_INITIALIZER(hpsjam_eq_cache_head);
+static size_t hpsjam_eq_cache_num;
+
+/*
+ * Build a cache key from the filter sizes and the raw filter text.
+ * The text is not normalized, so that a cache hit accepts and
+ * rejects exactly the same configurations as a fresh design.
+ */
+static char *
+hpsjam_equalizer_key(size_t size, size_t osize, const char *pfilter)
+{
+	char *key = (char *)malloc(strlen(pfilter) + 64);
+
+	if (key == 0)
+		return (0);
+	sprintf(key, "%zu %zu\n%s", size, osize, pfilter);
+	return (key);
+}
+
+static class hpsjam_equalizer_design *
+hpsjam_equalizer_design_create(size_t size, size_t osize, const char *pfilter)
+{
+	class hpsjam_equalizer_design *pd;
+	struct equalizer eq = {};
+
+	/* check if EQ should be enabled */
+	if (size != 0) {
+		eq.init(HPSJAM_SAMPLE_RATE, size);
+
+		if (eq.load(pfilter)) {
+			eq.cleanup();
+			return (0);
+		}
+	}
+
+	pd = new class hpsjam_equalizer_design;
+	pd->refs = 1;
+	pd->key = 0;
+	pd->filter_size = size;
+	pd->filter_predelay = osize;
+	pd->part_count = 0;
+	pd->filter_data = 0;
+	pd->part_filter = 0;
+
+	if (size > HPSJAM_EQ_PARTITION) {
+		kiss_fftr_cfg forward = kiss_fftr_alloc(2 * HPSJAM_EQ_PARTITION, false, 0, 0);
+		float temp[2 * HPSJAM_EQ_PARTITION];
+
+		pd->part_count = (size + HPSJAM_EQ_PARTITION - 1) / HPSJAM_EQ_PARTITION;
+		pd->part_filter = new kiss_fft_cpx [pd->part_count * HPSJAM_EQ_BINS];
+
+		/* compute the spectrum of each partition, scaled for the inverse transform */
+		for (size_t x = 0; x != pd->part_count; x++) {
+			memset(temp, 0, sizeof(temp));
+
+			for (size_t y = 0; y != HPSJAM_EQ_PARTITION; y++) {
+				const size_t z = x * HPSJAM_EQ_PARTITION + y;
+				if (z >= size)
+					break;
+				temp[y] = eq.kiss_time[z].r / (2 * HPSJAM_EQ_PARTITION);
+			}
+			kiss_fftr(forward, temp, pd->part_filter + x * HPSJAM_EQ_BINS);
+		}
+		kiss_fftr_free(forward);
+	} else if (size != 0) {
+		pd->filter_data = new float [size];
+
+		for (size_t x = 0; x != size; x++)
+			pd->filter_data[x] = eq.kiss_time[x].r;
+	}
+
+	if (size != 0)
+		eq.cleanup();
+	return (pd);
+}
+
+static void
+hpsjam_equalizer_design_unref(class hpsjam_equalizer_design *pd)
+{
+	if (pd == 0 || --(pd->refs) != 0)
+		return;
+	free(pd->key);
+	delete [] pd->filter_data;
+	delete [] pd->part_filter;
+	delete pd;
+}
+
+/* lookup or create a filter design, the least recently used are evicted */
+static class hpsjam_equalizer_design *
+hpsjam_equalizer_design_get(size_t size, size_t osize, const char *pfilter)
+{
+	class hpsjam_equalizer_design *pd;
+	class hpsjam_equalizer_design *pn;
+	char *key = hpsjam_equalizer_key(size, osize, pfilter);
+
+	if (key == 0)
+		return (0);
+
+	hpsjam_eq_cache_mtx.lock();
+	TAILQ_FOREACH(pd, &hpsjam_eq_cache_head, entry) {
+		if (strcmp(pd->key, key) == 0)
+			break;
+	}
+	if (pd != 0) {
+		TAILQ_REMOVE(&hpsjam_eq_cache_head, pd, entry);
+		TAILQ_INSERT_HEAD(&hpsjam_eq_cache_head, pd, entry);
+		pd->refs++;
+		hpsjam_eq_cache_mtx.unlock();
+		free(key);
+		return (pd);
+	}
+	hpsjam_eq_cache_mtx.unlock();
+
+	/* design the filter without holding the lock */
+	pn = hpsjam_equalizer_design_create(size, osize, pfilter);
+	if (pn == 0) {
+		free(key);
+		return (0);
+	}
+	pn->key = key;
+	pn->refs++;
+
+	hpsjam_eq_cache_mtx.lock();
+	/* check if someone else added the same design meanwhile */
+	TAILQ_FOREACH(pd, &hpsjam_eq_cache_head, entry) {
+		if (strcmp(pd->key, key) == 0)
+			break;
+	}
+	if (pd != 0) {
+		pd->refs++;
+		hpsjam_eq_cache_mtx.unlock();
+		pn->refs = 1;
+		hpsjam_equalizer_design_unref(pn);
+		return (pd);
+	}
+	TAILQ_INSERT_HEAD(&hpsjam_eq_cache_head, pn, entry);
+	if (++hpsjam_eq_cache_num > HPSJAM_EQ_CACHE_MAX) {
+		pd = TAILQ_LAST(&hpsjam_eq_cache_head, hpsjam_equalizer_design_head);
+		TAILQ_REMOVE(&hpsjam_eq_cache_head, pd, entry);
+		hpsjam_eq_cache_num--;
+		hpsjam_equalizer_design_unref(pd);
+	}
+	hpsjam_eq_cache_mtx.unlock();
+	return (pn);
+}
+
 bool
 hpsjam_equalizer :: init(const char *pfilter)
 {
+	class hpsjam_equalizer_design *pd;
+
 	/* check if filter starts with filtersize */
 	if (strncasecmp(pfilter, "filtersize ", 11) != 0)
 		return (true);
@@ -260,24 +447,38 @@ hpsjam_equalizer :: init(const char *pfilter)
 		pfilter++;
 	}
 
-	struct equalizer eq = {};
-
-	/* check if EQ should be enabled */
-	if (size != 0) {
-		eq.init(HPSJAM_SAMPLE_RATE, size);
-
-		if (eq.load(pfilter)) {
-			eq.cleanup();
-			return (true);
-		}
-	}
+	pd = hpsjam_equalizer_design_get(size, osize, pfilter);
+	if (pd == 0)
+		return (true);
 
 	/* allocate new buffers, if any */
 	if (filter_size != (size_t)size || filter_predelay != (size_t)osize) {
 		cleanup();
 
-		if (size != 0) {
-			filter_data = new float [size];
+		if (size > HPSJAM_EQ_PARTITION) {
+			constexpr size_t bins = HPSJAM_EQ_BINS;
+
+			part_count = pd->part_count;
+			part_forward = kiss_fftr_alloc(2 * HPSJAM_EQ_PARTITION, false, 0, 0);
+			part_inverse = kiss_fftr_alloc(2 * HPSJAM_EQ_PARTITION, true, 0, 0);
+			part_time = new float [2 * HPSJAM_EQ_PARTITION];
+			part_fdl[0] = new kiss_fft_cpx [part_count * bins];
+			part_fdl[1] = new kiss_fft_cpx [part_count * bins];
+			part_sum = new kiss_fft_cpx [bins];
+			filter_in[0] = new float [2 * HPSJAM_EQ_PARTITION];
+			filter_in[1] = new float [2 * HPSJAM_EQ_PARTITION];
+			filter_out[0] = new float [HPSJAM_EQ_PARTITION];
+			filter_out[1] = new float [HPSJAM_EQ_PARTITION];
+
+			memset(part_fdl[0], 0, sizeof(kiss_fft_cpx) * part_count * bins);
+			memset(part_fdl[1], 0, sizeof(kiss_fft_cpx) * part_count * bins);
+			memset(filter_in[0], 0, sizeof(float) * 2 * HPSJAM_EQ_PARTITION);
+			memset(filter_in[1], 0, sizeof(float) * 2 * HPSJAM_EQ_PARTITION);
+			memset(filter_out[0], 0, sizeof(float) * HPSJAM_EQ_PARTITION);
+			memset(filter_out[1], 0, sizeof(float) * HPSJAM_EQ_PARTITION);
+
+			filter_size = size;
+		} else if (size != 0) {
 			filter_in[0] = new float [size];
 			filter_in[1] = new float [size];
 			filter_out[0] = new float [2 * size];
@@ -298,31 +499,123 @@ hpsjam_equalizer :: init(const char *pfilter)
 
 			filter_predelay = osize;
 		}
+	} else {
+		hpsjam_equalizer_design_unref(design);
 	}
 
-	if (size != 0) {
-		for (ssize_t x = 0; x != size; x++)
-			filter_data[x] = eq.kiss_time[x].r;
+	/* the filter itself is shared */
+	design = pd;
+	filter_data = pd->filter_data;
+	part_filter = pd->part_filter;
 
-		eq.cleanup();
-	}
 	return (false);
 }
 
 void
 hpsjam_equalizer :: cleanup()
 {
-	delete [] filter_data;
+	hpsjam_equalizer_design_unref(design);
+
 	delete [] filter_in[0];
 	delete [] filter_in[1];
 	delete [] filter_out[0];
 	delete [] filter_out[1];
 	delete [] filter_delay[0];
 	delete [] filter_delay[1];
+	delete [] part_time;
+	delete [] part_fdl[0];
+	delete [] part_fdl[1];
+	delete [] part_sum;
+
+	if (part_forward != 0)
+		kiss_fftr_free(part_forward);
+	if (part_inverse != 0)
+		kiss_fftr_free(part_inverse);
 
 	memset(this, 0, sizeof(*this));
 }
 
+/*
+ * Take over the input history of another equalizer, when the
+ * predelay is the same, so that the new filter has valid output
+ * right away.
+ */
+void
+hpsjam_equalizer :: copyHistory(const hpsjam_equalizer &other)
+{
+	constexpr size_t bins = HPSJAM_EQ_BINS;
+
+	if (filter_predelay != other.filter_predelay)
+		return;
+
+	for (size_t ch = 0; ch != 2; ch++) {
+		if (filter_predelay != 0) {
+			memcpy(filter_delay[ch], other.filter_delay[ch],
+			    sizeof(float) * filter_predelay);
+		}
+
+		if (part_count == 0 || other.part_count == 0)
+			continue;
+
+		memcpy(filter_in[ch], other.filter_in[ch],
+		    sizeof(float) * 2 * HPSJAM_EQ_PARTITION);
+
+		/* copy the past input spectrums, oldest last */
+		for (size_t x = 1; x < part_count && x < other.part_count; x++) {
+			const size_t y = (other.part_index + other.part_count - x) %
+			    other.part_count;
+
+			memcpy(part_fdl[ch] + (part_count - x) * bins,
+			    other.part_fdl[ch] + y * bins, sizeof(kiss_fft_cpx) * bins);
+		}
+	}
+
+	filter_doffset = other.filter_doffset;
+
+	if (part_count != 0 && other.part_count != 0) {
+		filter_offset = other.filter_offset;
+		part_index = 0;
+	}
+}
+
+/*
+ * Overlap-save convolution of the last two partitions of input
+ * samples with all the filter partitions, using a frequency domain
+ * delay line of the past input spectrums.
+ */
+void
+hpsjam_equalizer :: doPartition(size_t ch)
+{
+	constexpr size_t bins = HPSJAM_EQ_BINS;
+	kiss_fft_cpx * const fdl = part_fdl[ch];
+
+	/* transform the input */
+	kiss_fftr(part_forward, filter_in[ch], fdl + part_index * bins);
+
+	memcpy(filter_in[ch], filter_in[ch] + HPSJAM_EQ_PARTITION,
+	    sizeof(float) * HPSJAM_EQ_PARTITION);
+
+	/* multiply and accumulate all partitions */
+	memset(part_sum, 0, sizeof(part_sum[0]) * bins);
+
+	for (size_t x = 0, y = part_index; x != part_count; x++) {
+		const kiss_fft_cpx *pa = fdl + y * bins;
+		const kiss_fft_cpx *pb = part_filter + x * bins;
+
+		for (size_t z = 0; z != bins; z++) {
+			part_sum[z].r += pa[z].r * pb[z].r - pa[z].i * pb[z].i;
+			part_sum[z].i += pa[z].r * pb[z].i + pa[z].i * pb[z].r;
+		}
+		y = (y == 0) ? (part_count - 1) : (y - 1);
+	}
+
+	/* transform the output, the first half is aliased */
+	kiss_fftri(part_inverse, part_sum, part_time);
+
+	memcpy(filter_out[ch], part_time + HPSJAM_EQ_PARTITION,
+	    sizeof(float) * HPSJAM_EQ_PARTITION);
+}
+
 void
 hpsjam_equalizer :: doit(float *left, float *right, size_t samples)
 {
@@ -339,6 +632,40 @@ hpsjam_equalizer :: doit(float *left, float *right, size_t samples)
 		}
 	}
 
+	/* execute partitioned equalizer, if any */
+	if (part_count != 0) {
+		do {
+			size_t delta = HPSJAM_EQ_PARTITION - filter_offset;
+
+			if (delta > samples)
+				delta = samples;
+
+			for (size_t y = 0; y != delta; y++) {
+				filter_in[0][y + filter_offset + HPSJAM_EQ_PARTITION] = left[y];
+				left[y] = filter_out[0][y + filter_offset];
+
+				filter_in[1][y + filter_offset + HPSJAM_EQ_PARTITION] = right[y];
+				right[y] = filter_out[1][y + filter_offset];
+			}
+
+			filter_offset += delta;
+			samples -= delta;
+			left += delta;
+			right += delta;
+
+			/* check if there is enough data for a new partition */
+			if (filter_offset == HPSJAM_EQ_PARTITION) {
+				doPartition(0);
+				doPartition(1);
+
+				if (++part_index == part_count)
+					part_index = 0;
+				filter_offset = 0;
+			}
+		} while (samples != 0);
+		return;
+	}
+
 	/* execute equalizer, if any */
 	if (filter_size != 0) {
 		do {
@@ -377,3 +704,196 @@ hpsjam_equalizer :: doit(float *left, float *right, size_t samples)
 		} while (samples != 0);
 	}
 }
+
+static std::atomic<class hpsjam_equalizer_switch *> hpsjam_equalizer_queue;
+
+static void
+hpsjam_equalizer_free(class hpsjam_equalizer *eq)
+{
+	if (eq == 0)
+		return;
+	eq->cleanup();
+	delete eq;
+}
+
+/* hand the switch to the worker, unless it is queued already */
+void
+hpsjam_equalizer_switch :: queue(uint8_t flags)
+{
+	if (state.fetch_or(QUEUED | flags) & QUEUED)
+		return;
+
+	/* the worker always takes the whole list, so there is no ABA problem */
+	class hpsjam_equalizer_switch *head = hpsjam_equalizer_queue.load();
+	do {
+		next = head;
+	} while (hpsjam_equalizer_queue.compare_exchange_weak(head, this) == false);
+}
+
+static void
+hpsjam_equalizer_work(class hpsjam_equalizer_switch &sw, char *config)
+{
+	/* clearing the queued flag allows the switch to be queued again */
+	const uint8_t state = sw.state.fetch_and(~hpsjam_equalizer_switch::QUEUED);
+
+	if (state & hpsjam_equalizer_switch::DYING) {
+		hpsjam_equalizer_free(sw.pending.exchange(0));
+		hpsjam_equalizer_free(sw.retired.exchange(0));
+		hpsjam_equalizer_free(sw.current);
+		hpsjam_equalizer_free(sw.previous);
+		delete &sw;
+		return;
+	}
+
+	/* free the filter given back by the audio thread, if any */
+	hpsjam_equalizer_free(sw.retired.exchange(0));
+
+	/* get a consistent copy of the configuration, if new */
+	const uint32_t seq = sw.config_seq.load(std::memory_order_acquire);
+	if ((seq & 1) || seq == sw.config_done)
+		return;	/* the writer queues the switch again, when done */
+	memcpy(config, sw.config, HPSJAM_EQ_CONFIG_MAX);
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (sw.config_seq.load(std::memory_order_relaxed) != seq)
+		return;
+	config[HPSJAM_EQ_CONFIG_MAX - 1] = 0;
+	sw.config_done = seq;
+
+	/* design filter and allocate buffers */
+	class hpsjam_equalizer *eq = new class hpsjam_equalizer;
+	if (eq->init(config)) {
+		hpsjam_equalizer_free(eq);
+		return;
+	}
+
+	/* publish new filter, replacing any unused one */
+	hpsjam_equalizer_free(sw.pending.exchange(eq));
+}
+
+static void *
+hpsjam_equalizer_worker_loop(void *)
+{
+	static char config[HPSJAM_EQ_CONFIG_MAX];
+
+	while (1) {
+		class hpsjam_equalizer_switch *psw = hpsjam_equalizer_queue.exchange(0);
+
+		if (psw == 0) {
+			usleep(HPSJAM_EQ_POLL);
+			continue;
+		}
+
+		while (psw != 0) {
+			/* the switch may be queued again or freed below */
+			class hpsjam_equalizer_switch *next = psw->next;
+
+			hpsjam_equalizer_work(*psw, config);
+			psw = next;
+		}
+	}
+	return (0);
+}
+
+void
+hpsjam_equalizer_worker_init()
+{
+	pthread_t pt;
+
+	if (pthread_create(&pt, 0, &hpsjam_equalizer_worker_loop, 0) != 0)
+		errx(1, "Could not create equalizer thread");
+	pthread_detach(pt);
+}
+
+/* the switch must no longer be used by the caller */
+void
+hpsjam_equalizer_switch_free(class hpsjam_equalizer_switch *psw)
+{
+	if (psw != 0)
+		psw->queue(hpsjam_equalizer_switch::DYING);
+}
+
+/* queue a new filter configuration, the last one wins */
+void
+hpsjam_equalizer_switch :: init(const char *pfilter, size_t len)
+{
+	if (len > sizeof(config) - 1)
+		len = sizeof(config) - 1;
+
+	config_seq.fetch_add(1, std::memory_order_acq_rel);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(config, pfilter, len);
+	config[len] = 0;
+	config_seq.fetch_add(1, std::memory_order_release);
+
+	queue(0);
+}
+
+/* check if doit() has any effect on the audio */
+bool
+hpsjam_equalizer_switch :: isActive() const
+{
+	if (fade != 0 || previous != 0 || pending.load() != 0)
+		return (true);
+	return (current != 0 &&
+	    (current->filter_size != 0 || current->filter_predelay != 0));
+}
+
+void
+hpsjam_equalizer_switch :: doit(float *left, float *right, size_t samples)
+{
+	/* check for a new filter, when the previous one is gone */
+	if (fade == 0 && previous == 0) {
+		class hpsjam_equalizer *eq = pending.exchange(0);
+
+		if (eq != 0) {
+			if (current != 0)
+				eq->copyHistory(*current);
+			previous = current;
+			current = eq;
+			fade = HPSJAM_EQ_FADE;
+		}
+	}
+
+	/* crossfade from the previous filter, or no filter */
+	while (fade != 0 && samples != 0) {
+		float temp[2][HPSJAM_DEF_SAMPLES];
+		size_t delta = HPSJAM_DEF_SAMPLES;
+
+		if (delta > samples)
+			delta = samples;
+		if (delta > fade)
+			delta = fade;
+
+		memcpy(temp[0], left, sizeof(float) * delta);
+		memcpy(temp[1], right, sizeof(float) * delta);
+
+		if (previous != 0)
+			previous->doit(temp[0], temp[1], delta);
+		current->doit(left, right, delta);
+
+		for (size_t x = 0; x != delta; x++) {
+			const float w = (float)(HPSJAM_EQ_FADE - fade + x + 1) / HPSJAM_EQ_FADE;
+
+			left[x] = temp[0][x] + (left[x] - temp[0][x]) * w;
+			right[x] = temp[1][x] + (right[x] - temp[1][x]) * w;
+		}
+
+		fade -= delta;
+		samples -= delta;
+		left += delta;
+		right += delta;
+	}
+
+	/* give the previous filter back to the worker for freeing */
+	if (fade == 0 && previous != 0) {
+		class hpsjam_equalizer *null = 0;
+
+		if (retired.compare_exchange_strong(null, previous)) {
+			previous = 0;
+			queue(0);
+		}
+	}
+
+	if (samples != 0 && current != 0)
+		current->doit(left, right, samples);
+}
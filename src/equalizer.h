@@ -29,6 +29,14 @@
 #include <stdbool.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/queue.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include <kiss_fftr.h>
+
+class hpsjam_equalizer_design;
 
 class hpsjam_equalizer {
 public:
@@ -39,14 +47,72 @@ public:
 	size_t filter_predelay;
 	size_t filter_offset;
 	size_t filter_doffset;
-	float *filter_data;
+	class hpsjam_equalizer_design *design;
+	const float *filter_data;
 	float *filter_in[2];
 	float *filter_out[2];
 	float *filter_delay[2];
 
+	/* uniformly partitioned convolution, used for long filters */
+	size_t part_count;
+	size_t part_index;
+	float *part_time;
+	const kiss_fft_cpx *part_filter;
+	kiss_fft_cpx *part_fdl[2];
+	kiss_fft_cpx *part_sum;
+	kiss_fftr_cfg part_forward;
+	kiss_fftr_cfg part_inverse;
+
 	bool init(const char *);
 	void cleanup();
+	void copyHistory(const hpsjam_equalizer &);
+	void doPartition(size_t);
 	void doit(float *left, float *right, size_t samples);
 };
 
+#define	HPSJAM_EQ_CONFIG_MAX 1024	/* bytes, larger than any EQ packet */
+
+/*
+ * Equalizer which is designed by a background thread. New filters
+ * are passed to the audio thread by an atomic pointer swap, and are
+ * crossfaded with the previous filter. The configuration is passed
+ * to the worker through a sequence locked buffer and a lock-free
+ * queue, so that neither init() nor doit() allocate or block.
+ * Switches are freed by the worker, see hpsjam_equalizer_switch_free().
+ */
+class hpsjam_equalizer_switch {
+public:
+	enum { QUEUED = 1, DYING = 2 };
+
+	hpsjam_equalizer_switch() : pending(0), retired(0), state(0), config_seq(0) {
+		next = 0;
+		current = 0;
+		previous = 0;
+		fade = 0;
+		config_done = 0;
+		config[0] = 0;
+	};
+	class hpsjam_equalizer_switch *next;	/* worker queue */
+	std::atomic<class hpsjam_equalizer *> pending;	/* set by worker */
+	std::atomic<class hpsjam_equalizer *> retired;	/* freed by worker */
+	std::atomic<uint8_t> state;
+	std::atomic<uint32_t> config_seq;	/* odd while config is written */
+	uint32_t config_done;	/* last designed config_seq, worker only */
+	class hpsjam_equalizer *current;
+	class hpsjam_equalizer *previous;
+	size_t fade;
+	char config[HPSJAM_EQ_CONFIG_MAX];
+
+	void queue(uint8_t);
+	void init(const char *, size_t);
+	void init(const char *pfilter) {
+		init(pfilter, strlen(pfilter));
+	};
+	bool isActive() const;
+	void doit(float *left, float *right, size_t samples);
+};
+
+extern void hpsjam_equalizer_worker_init();
+extern void hpsjam_equalizer_switch_free(class hpsjam_equalizer_switch *);
+
 #endif		/* _HPSJAM_EQUALIZER_ */
@@ -65,6 +65,12 @@ struct hpsjam_socket_address hpsjam_cli;
 const char *hpsjam_welcome_message_file;
 int hpsjam_profile_index;
 bool hpsjam_no_multi_port;
+bool hpsjam_drift_compensation;
+bool hpsjam_loss_concealment;
+unsigned hpsjam_jitter_percentile;
+unsigned hpsjam_water_window;
+bool hpsjam_server_processing;
+bool hpsjam_true_peak_meter;
 
 static const struct option hpsjam_opts[] = {
 	{ "NSDocumentRevisionsDebugMode", required_argument, NULL, ' ' },
@@ -79,6 +85,7 @@ static const struct option hpsjam_opts[] = {
 #ifdef HAVE_HTTPD
 	{ "httpd", required_argument, NULL, 't' },
 	{ "httpd-conns", required_argument, NULL, 'T' },
+	{ "httpd-clients", required_argument, NULL, 'H' },
 #endif
 	{ "welcome-msg-file", required_argument, NULL, 'w' },
 	{ "server", no_argument, NULL, 's' },
@@ -111,6 +118,12 @@ static const struct option hpsjam_opts[] = {
 #endif
 	{ "audio-input-jitter", required_argument, NULL, 'v'},
 	{ "audio-output-jitter", required_argument, NULL, 'V'},
+	{ "audio-drift-compensation", no_argument, NULL, 'a'},
+	{ "audio-loss-concealment", no_argument, NULL, 'C'},
+	{ "audio-jitter-percentile", required_argument, NULL, 'A'},
+	{ "audio-water-window", required_argument, NULL, 'W'},
+	{ "server-mixer-processing", no_argument, NULL, 'E'},
+	{ "audio-true-peak-meter", no_argument, NULL, 'Y'},
 #ifdef __FreeBSD__
 	{ "rtprio", required_argument, NULL, 'x' },
 #endif
@@ -176,11 +189,18 @@ usage(void)
 #ifdef HAVE_HTTPD
 		"	[--httpd <servername:port, Default port is 80>] \\\n"
 		"	[--httpd-conns <max number of connections, Default is 1> \\\n"
+		"	[--httpd-clients <max number of page requests, Default is 64> \\\n"
 #endif
 		"	[--audio-uplink-format <0..%u>] \\\n"
 		"	[--audio-downlink-format <0..%u>] \\\n"
 		"	[--audio-input-jitter <0..%u milliseconds, Default is 8 ms>] \\\n"
 		"	[--audio-output-jitter <0..%u milliseconds, Default is 8 ms>] \\\n"
+		"	[--audio-drift-compensation] \\\n"
+		"	[--audio-loss-concealment] \\\n"
+		"	[--audio-jitter-percentile <50..100, Default is disabled>] \\\n"
+		"	[--audio-water-window <1..10000 milliseconds, Default is 16 ms>] \\\n"
+		"	[--server-mixer-processing] \\\n"
+		"	[--audio-true-peak-meter] \\\n"
 #if defined(HAVE_MAC_AUDIO) || defined(HAVE_IOS_AUDIO) || defined(HAVE_ASIO_AUDIO) || defined(HAVE_OBOE_AUDIO)
 		"	[--audio-input-device <0,1,2,3 ... , Default is 0>] \\\n"
 		"	[--audio-output-device <0,1,2,3 ... , Default is 0>] \\\n"
@@ -215,7 +235,7 @@ Q_DECL_EXPORT int
 main(int argc, char **argv)
 {
 	static const char hpsjam_short_opts[] = {
-	    "M:q:p:sP:hBJ:n:K:w:mN:gi:j:c:U:D:I:O:l:L:r:R:t:T:v:V:b:x:"
+	    "M:q:p:sP:hBJ:n:K:w:mN:gi:j:c:U:D:I:O:l:L:r:R:t:T:H:v:V:b:x:aCA:W:EY"
 	};
 	int c;
 	int port = HPSJAM_DEFAULT_PORT;
@@ -271,6 +291,11 @@ main(int argc, char **argv)
 			if (http_nstate == 0 || http_host == 0 || http_port == 0)
 				usage();
 			break;
+		case 'H':
+			http_nclient = atoi(optarg);
+			if (http_nclient == 0 || http_host == 0 || http_port == 0)
+				usage();
+			break;
 #endif
 		case 'w':
 			hpsjam_welcome_message_file = optarg;
@@ -399,6 +424,30 @@ main(int argc, char **argv)
 		case 'm':
 			hpsjam_no_multi_port = true;
 			break;
+		case 'a':
+			hpsjam_drift_compensation = true;
+			break;
+		case 'C':
+			hpsjam_loss_concealment = true;
+			break;
+		case 'A':
+			hpsjam_jitter_percentile = atoi(optarg);
+			if (hpsjam_jitter_percentile < 50 ||
+			    hpsjam_jitter_percentile > 100)
+				usage();
+			break;
+		case 'W':
+			hpsjam_water_window = atoi(optarg);
+			if (hpsjam_water_window < 1 ||
+			    hpsjam_water_window > 10000)
+				usage();
+			break;
+		case 'E':
+			hpsjam_server_processing = true;
+			break;
+		case 'Y':
+			hpsjam_true_peak_meter = true;
+			break;
 		case ' ':
 			/* ignore */
 			break;
@@ -440,6 +489,8 @@ main(int argc, char **argv)
 #if defined(HAVE_MAC_AUDIO) || defined(HAVE_IOS_AUDIO) || defined(HAVE_ASIO_AUDIO) || defined(HAVE_JACK_AUDIO) || defined(HAVE_OBOE_AUDIO)
 		hpsjam_sound_rescan();
 #endif
+		hpsjam_packet_pool.init(HPSJAM_POOL_PKT_MIN);
+		hpsjam_packet_node_pool.init(HPSJAM_POOL_PKT_MIN);
 		hpsjam_default_midi = new hpsjam_midi_buffer[1];
 		hpsjam_client_peer = new class hpsjam_client_peer;
 		hpsjam_client = new HpsJamClient();
@@ -591,25 +642,23 @@ main(int argc, char **argv)
 	} else {
 		QCoreApplication app(argc, argv);
 
+		hpsjam_packet_pool.init(HPSJAM_POOL_PKT_MIN +
+		    HPSJAM_POOL_DATA_PEER * hpsjam_num_server_peers);
+		hpsjam_packet_node_pool.init(HPSJAM_POOL_PKT_MIN +
+		    HPSJAM_POOL_PKT_PEER * hpsjam_num_server_peers);
 		hpsjam_default_midi = new hpsjam_midi_buffer[hpsjam_num_cpu];
 		hpsjam_server_peers = new class hpsjam_server_peer [hpsjam_num_server_peers];
 
 		for (unsigned x = 0; x != hpsjam_num_server_peers; x++) {
-			if (output_jitter > -1) {
-				hpsjam_server_peers[x].out_buffer[0].setWaterTarget(output_jitter);
-				hpsjam_server_peers[x].out_buffer[1].setWaterTarget(output_jitter);
-			} else {
-				hpsjam_server_peers[x].out_buffer[0].setWaterTarget(8);
-				hpsjam_server_peers[x].out_buffer[1].setWaterTarget(8);
-			}
-
-			if (input_jitter > -1) {
-				hpsjam_server_peers[x].in_audio[0].setWaterTarget(input_jitter);
-				hpsjam_server_peers[x].in_audio[1].setWaterTarget(input_jitter);
-			} else {
-				hpsjam_server_peers[x].in_audio[0].setWaterTarget(8);
-				hpsjam_server_peers[x].in_audio[1].setWaterTarget(8);
-			}
+			if (output_jitter > -1)
+				hpsjam_server_peers[x].out_buffer.setWaterTarget(output_jitter);
+			else
+				hpsjam_server_peers[x].out_buffer.setWaterTarget(8);
+
+			if (input_jitter > -1)
+				hpsjam_server_peers[x].in_audio.setWaterTarget(input_jitter);
+			else
+				hpsjam_server_peers[x].in_audio.setWaterTarget(8);
 		}
 
 		/* set a valid UDP buffer size */
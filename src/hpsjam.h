@@ -58,6 +58,9 @@
 #define	HPSJAM_SERVER_LIST_MAX 100
 #define	HPSJAM_CPU_MAX 64
 #define	HPSJAM_FEATURE_MULTI_PORT (1 << 1)
+#define	HPSJAM_FEATURE_TELEMETRY (1 << 2)
+#define	HPSJAM_FEATURE_CONCEALMENT (1 << 3)
+#define	HPSJAM_FEATURE_LEVEL_RMS (1 << 4)
 
 #define	HPSJAM_NO_SIGNAL(a,b) do {	\
   a.blockSignals(true);			\
@@ -93,6 +96,12 @@ extern const char *hpsjam_welcome_message_file;
 extern int hpsjam_profile_index;
 extern bool hpsjam_mute_peer_audio;
 extern bool hpsjam_no_multi_port;
+extern bool hpsjam_drift_compensation;
+extern bool hpsjam_loss_concealment;
+extern unsigned hpsjam_jitter_percentile;
+extern unsigned hpsjam_water_window;
+extern bool hpsjam_server_processing;
+extern bool hpsjam_true_peak_meter;
 
 extern void hpsjam_socket_init(unsigned short port, unsigned short cliport);
 
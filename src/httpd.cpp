@@ -49,23 +49,62 @@
 #include <netinet/tcp.h>
 
 #include <pthread.h>
+#include <time.h>
+
+#include <atomic>
 
 #include "hpsjam.h"
 #include "httpd.h"
 #include "timer.h"
 #include "compressor.h"
+#include "denormal.h"
 
 #define	HTTPD_BIND_MAX 8
 #define	HTTPD_MAX_STREAM_TIME (60 * 60 * 3)	/* seconds */
+#define	HTTPD_IDLE_TIMEOUT 5	/* seconds */
+#define	HTTPD_HEADER_MAX 2048	/* bytes */
+#define	HTTPD_SLOT_RESERVED -2	/* stream header is being sent */
+#define	HTTPD_RING_SIZE 16384	/* frames, power of two */
+#define	HTTPD_BATCH (HPSJAM_SAMPLE_RATE / 50)	/* frames, 20 ms */
+
+#ifdef MSG_NOSIGNAL
+#define	HTTPD_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define	HTTPD_SEND_FLAGS 0
+#endif
 
 struct http_state {
 	int	fd;
 	uint16_t ts;
 };
 
+/* connection waiting for, or receiving, a reply */
+struct http_client {
+	int	fd;
+	int	slot;	/* stream slot, if any */
+	time_t	ts;	/* request start or last send progress */
+	bool	keep_alive;
+	size_t	rx_len;
+	char	rx_buf[HTTPD_HEADER_MAX];
+	char *	tx_buf;
+	size_t	tx_len;
+	size_t	tx_off;
+};
+
+/* single producer, single consumer ring of stereo frames */
+struct http_ring {
+	float	data[HTTPD_RING_SIZE][HPSJAM_CHANNELS];
+	std::atomic<size_t> head;	/* advanced by the producer */
+	std::atomic<size_t> tail;	/* advanced by the consumer */
+	std::atomic<size_t> overruns;
+};
+
 static volatile struct http_state * http_state;
+static struct http_client * http_client;
+static struct http_ring http_ring;
 
 size_t http_nstate;
+size_t http_nclient = 64;
 const char * http_host;
 const char * http_port;
 
@@ -80,28 +119,25 @@ hpsjam_httpd_usage()
 	return (usage);
 }
 
-static char *
-hpsjam_httpd_read_line(FILE *io, char *linebuffer, size_t linelen)
+static time_t
+hpsjam_httpd_time()
 {
-	char buffer[2];
-	size_t size = 0;
-
-	if (fread(buffer, 1, 2, io) != 2)
-		return (0);
+	struct timespec ts;
 
-	while (1) {
-		if (buffer[0] == '\r' && buffer[1] == '\n')
-			break;
-		if (size == (linelen - 1))
-			return (0);
-		linebuffer[size++] = buffer[0];
-		buffer[0] = buffer[1];
-		if (fread(buffer + 1, 1, 1, io) != 1)
-			return (0);
-	}
-	linebuffer[size++] = 0;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec);
+}
 
-	return (linebuffer);
+static void
+hpsjam_httpd_close(struct http_client &c)
+{
+	if (c.slot >= 0)
+		http_state[c.slot].fd = -1;
+	close(c.fd);
+	free(c.tx_buf);
+	c.fd = -1;
+	c.slot = -1;
+	c.tx_buf = 0;
 }
 
 static int
@@ -266,31 +302,145 @@ hpsjam_http_generate_wav_header(FILE *io,
 	return (0);
 }
 
+/* queue a complete reply, with a body of known length */
+static void
+hpsjam_httpd_reply(FILE *io, struct http_client &c, const char *status,
+    const char *type, const char *body, size_t len)
+{
+	fprintf(io, "HTTP/1.1 %s\r\n"
+	    "Content-Type: %s\r\n"
+	    "Server: hpsjam/1.0\r\n"
+	    "Cache-Control: no-cache, no-store\r\n"
+	    "Expires: Mon, 26 Jul 1997 05:00:00 GMT\r\n"
+	    "Connection: %s\r\n"
+	    "Content-Length: %zu\r\n"
+	    "\r\n", status, type, c.keep_alive ? "Keep-Alive" : "Close", len);
+	fwrite(body, len, 1, io);
+}
+
+static void
+hpsjam_httpd_index(FILE *io, struct http_client &c)
+{
+	char *body = 0;
+	size_t len = 0;
+	FILE *temp;
+	size_t x;
+
+	temp = open_memstream(&body, &len);
+	if (temp == 0) {
+		c.keep_alive = false;
+		return;
+	}
+
+	x = hpsjam_httpd_usage();
+
+	fprintf(temp, "<html><head><title>Welcome to live streaming</title>"
+	    "<meta http-equiv=\"Cache-Control\" content=\"no-cache, no-store, must-revalidate\" />"
+	    "<meta http-equiv=\"Pragma\" content=\"no-cache\" />"
+	    "<meta http-equiv=\"Expires\" content=\"0\" />"
+	    "</head>"
+	    "<body>"
+	    "<h1>Live HD stream</h1>"
+	    "<br>"
+	    "<br>"
+	    "<h2>Alternative 1 (recommended)</h2>"
+	    "<ol type=\"1\">"
+	    "<li>Install <a href=\"https://www.videolan.org\">VideoLanClient (VLC)</a>, from App- or Play-store free of charge</li>"
+	    "<li>Open VLC and select Network Stream</li>"
+	    "<li>Enter, copy or share this network address to VLC: <a href=\"http://%s:%s/stream.m3u\">http://%s:%s/stream.m3u</a></li>"
+	    "</ol>"
+	    "<br>"
+	    "<br>"
+	    "<h2>Alternative 2 (on your own)</h2>"
+	    "<br>"
+	    "<br>"
+	    "<audio id=\"audio\" controls=\"true\" src=\"stream.wav\" preload=\"none\"></audio>"
+	    "<br>"
+	    "<br>",
+	    http_host, http_port,
+	    http_host, http_port);
+
+	if (x == http_nstate)
+		fprintf(temp, "<h2>There are currently no free slots (%zu active). Try again later!</h2>", x);
+	else
+		fprintf(temp, "<h2>There are %zu free slots (%zu active)</h2>", http_nstate - x, x);
+
+	/* audio blocks dropped because the stream thread fell behind */
+	x = http_ring.overruns.load(std::memory_order_relaxed);
+	if (x != 0)
+		fprintf(temp, "<p>%zu audio blocks were dropped</p>", x);
+
+	fprintf(temp, "</body></html>");
+	fclose(temp);
+
+	hpsjam_httpd_reply(io, c, "200 OK", "text/html", body, len);
+	free(body);
+}
+
+static void
+hpsjam_httpd_stream(FILE *io, struct http_client &c,
+    uintmax_t r_start, uintmax_t r_end, bool is_partial)
+{
+	size_t x;
+
+	c.keep_alive = false;
+
+	for (x = 0; x < http_nstate; x++) {
+		if (http_state[x].fd != -1)
+			continue;
+		switch (hpsjam_http_generate_wav_header(io, r_start, r_end, is_partial)) {
+		case 0:
+			/* hand over the connection after the header is sent */
+			http_state[x].fd = HTTPD_SLOT_RESERVED;
+			c.slot = x;
+			return;
+		case 1:
+			return;
+		case 2:
+			fprintf(io, "HTTP/1.1 416 Range Not Satisfiable\r\n"
+			    "Server: hpsjam/1.0\r\n"
+			    "\r\n");
+			return;
+		default:
+			return;
+		}
+	}
+	fprintf(io, "HTTP/1.0 503 Out of Resources\r\n"
+	    "Server: hpsjam/1.0\r\n"
+	    "\r\n");
+}
+
+/* parse a complete request header and queue the reply */
 static void
-hpsjam_httpd_handle_connection(int fd, const struct sockaddr_in *sa)
+hpsjam_httpd_request(struct http_client &c, char *header)
 {
-	char linebuffer[2048];
+	static const char notfound[] =
+	    "<html><head><title>Virtual OSS</title></head>"
+	    "<body>"
+	    "<h1>Invalid page requested! "
+	    "<a HREF=\"index.html\">Click here to go back</a>.</h1><br>"
+	    "</body>"
+	    "</html>";
 	uintmax_t r_start = 0;
 	uintmax_t r_end = -1ULL;
 	bool is_partial = false;
 	char *line;
+	char *next;
 	FILE *io;
-	size_t x;
 	int page;
 
-	io = fdopen(fd, "r+");
-	if (io == 0)
-		goto done;
-
 	page = -1;
 
-	/* dump HTTP request header */
-	while (1) {
-		line = hpsjam_httpd_read_line(io, linebuffer, sizeof(linebuffer));
-		if (line == 0)
-			goto done;
-		if (line[0] == 0)
+	/* HTTP/1.1 defaults to persistent connections */
+	c.keep_alive = (strstr(header, " HTTP/1.1\r\n") != 0);
+
+	for (line = header; *line != 0; line = next) {
+		next = strstr(line, "\r\n");
+		if (next == 0)
 			break;
+		*next = 0;
+		next += 2;
+
 		if (page < 0 && (strstr(line, "GET / ") == line ||
 		    strstr(line, "GET /index.html") == line)) {
 			page = 0;
@@ -299,127 +449,133 @@ hpsjam_httpd_handle_connection(int fd, const struct sockaddr_in *sa)
 		} else if (page < 0 && strstr(line, "GET /stream.m3u") == line) {
 			page = 2;
 		} else if (strstr(line, "Range: bytes=") == line &&
-		    sscanf(line, "Range: bytes=%zu-%zu", &r_start, &r_end) >= 1) {
+		    sscanf(line, "Range: bytes=%ju-%ju", &r_start, &r_end) >= 1) {
 			is_partial = true;
+		} else if (strcasestr(line, "Connection:") == line) {
+			if (strcasestr(line, "close") != 0)
+				c.keep_alive = false;
+			else if (strcasestr(line, "keep-alive") != 0)
+				c.keep_alive = true;
 		}
 	}
 
+	io = open_memstream(&c.tx_buf, &c.tx_len);
+	if (io == 0) {
+		hpsjam_httpd_close(c);
+		return;
+	}
+
 	switch (page) {
 	case 0:
-		x = hpsjam_httpd_usage();
-
-		fprintf(io, "HTTP/1.0 200 OK\r\n"
-		    "Content-Type: text/html\r\n"
-		    "Server: hpsjam/1.0\r\n"
-		    "Cache-Control: no-cache, no-store\r\n"
-		    "Expires: Mon, 26 Jul 1997 05:00:00 GMT\r\n"
-		    "\r\n"
-		    "<html><head><title>Welcome to live streaming</title>"
-		    "<meta http-equiv=\"Cache-Control\" content=\"no-cache, no-store, must-revalidate\" />"
-		    "<meta http-equiv=\"Pragma\" content=\"no-cache\" />"
-		    "<meta http-equiv=\"Expires\" content=\"0\" />"
-		    "</head>"
-		    "<body>"
-		    "<h1>Live HD stream</h1>"
-		    "<br>"
-		    "<br>"
-		    "<h2>Alternative 1 (recommended)</h2>"
-		    "<ol type=\"1\">"
-		    "<li>Install <a href=\"https://www.videolan.org\">VideoLanClient (VLC)</a>, from App- or Play-store free of charge</li>"
-		    "<li>Open VLC and select Network Stream</li>"
-		    "<li>Enter, copy or share this network address to VLC: <a href=\"http://%s:%s/stream.m3u\">http://%s:%s/stream.m3u</a></li>"
-		    "</ol>"
-		    "<br>"
-		    "<br>"
-		    "<h2>Alternative 2 (on your own)</h2>"
-		    "<br>"
-		    "<br>"
-		    "<audio id=\"audio\" controls=\"true\" src=\"stream.wav\" preload=\"none\"></audio>"
-		    "<br>"
-		    "<br>",
-		    http_host, http_port,
-		    http_host, http_port);
-
-		if (x == http_nstate)
-			fprintf(io, "<h2>There are currently no free slots (%zu active). Try again later!</h2>", x);
-		else
-			fprintf(io, "<h2>There are %zu free slots (%zu active)</h2>", http_nstate - x, x);
-
-		fprintf(io, "</body></html>");
+		hpsjam_httpd_index(io, c);
 		break;
 	case 1:
-		for (x = 0; x < http_nstate; x++) {
-			if (http_state[x].fd >= 0)
-				continue;
-			switch (hpsjam_http_generate_wav_header(io, r_start, r_end, is_partial)) {
-				static const int enable = 1;
-
-			case 0:
-				fflush(io);
-#if defined(__linux__) || defined(__APPLE__)
-				fd = dup(fd);
-				fclose(io);
-#else
-				fdclose(io, 0);
-#endif
-				if (ioctl(fd, FIONBIO, &enable) != 0) {
-					close(fd);
-					return;
-				}
-				http_state[x].ts = hpsjam_ticks - 100;
-				http_state[x].fd = fd;
-				return;
-			case 1:
-				fclose(io);
-				return;
-			case 2:
-				fprintf(io, "HTTP/1.1 416 Range Not Satisfiable\r\n"
-				    "Server: hpsjam/1.0\r\n"
-				    "\r\n");
-				goto done;
-			default:
-				goto done;
-			}
-		}
-		fprintf(io, "HTTP/1.0 503 Out of Resources\r\n"
-		    "Server: hpsjam/1.0\r\n"
-		    "\r\n");
+		hpsjam_httpd_stream(io, c, r_start, r_end, is_partial);
 		break;
 	case 2:
-		fprintf(io, "HTTP/1.0 200 OK\r\n"
-		    "Content-Type: audio/mpegurl\r\n"
-		    "Server: hpsjam/1.0\r\n"
-		    "Cache-Control: no-cache, no-store\r\n"
-		    "Expires: Mon, 26 Jul 1997 05:00:00 GMT\r\n"
-		    "\r\n"
-		    "http://%s:%s/stream.wav\r\n",
-		    http_host, http_port);
+		if (asprintf(&line, "http://%s:%s/stream.wav\r\n",
+		    http_host, http_port) < 0) {
+			c.keep_alive = false;
+			break;
+		}
+		hpsjam_httpd_reply(io, c, "200 OK", "audio/mpegurl", line, strlen(line));
+		free(line);
 		break;
 	default:
-		fprintf(io, "HTTP/1.0 404 Not Found\r\n"
-		    "Content-Type: text/html\r\n"
-		    "Server: hpsjam/1.0\r\n"
-		    "\r\n"
-		    "<html><head><title>Virtual OSS</title></head>"
-		    "<body>"
-		    "<h1>Invalid page requested! "
-		    "<a HREF=\"index.html\">Click here to go back</a>.</h1><br>"
-		    "</body>"
-		    "</html>");
+		hpsjam_httpd_reply(io, c, "404 Not Found", "text/html",
+		    notfound, sizeof(notfound) - 1);
 		break;
 	}
-done:
-	if (io != 0)
-		fclose(io);
-	else
-		close(fd);
+	fclose(io);
+	c.tx_off = 0;
+}
+
+/* process the next complete request in the receive buffer, if any */
+static void
+hpsjam_httpd_parse(struct http_client &c)
+{
+	char *end;
+	size_t len;
+
+	c.rx_buf[c.rx_len] = 0;
+	end = strstr(c.rx_buf, "\r\n\r\n");
+	if (end == 0)
+		return;
+
+	len = end + 4 - c.rx_buf;
+	end[2] = 0;
+
+	hpsjam_httpd_request(c, c.rx_buf);
+
+	/* keep pipelined requests, if any */
+	c.rx_len -= len;
+	memmove(c.rx_buf, c.rx_buf + len, c.rx_len);
+}
+
+static void
+hpsjam_httpd_input(struct http_client &c)
+{
+	ssize_t len;
+
+	len = recv(c.fd, c.rx_buf + c.rx_len, sizeof(c.rx_buf) - 1 - c.rx_len, 0);
+	if (len == 0 || (len < 0 && errno != EWOULDBLOCK && errno != EINTR)) {
+		hpsjam_httpd_close(c);
+		return;
+	} else if (len < 0) {
+		return;
+	}
+	/* partial headers do not extend the deadline set at request start */
+	c.rx_len += len;
+
+	hpsjam_httpd_parse(c);
+
+	/* check for too big request header */
+	if (c.fd != -1 && c.tx_buf == 0 && c.rx_len == sizeof(c.rx_buf) - 1)
+		hpsjam_httpd_close(c);
+}
+
+static void
+hpsjam_httpd_output(struct http_client &c)
+{
+	ssize_t len;
+
+	while (c.tx_off != c.tx_len) {
+		len = send(c.fd, c.tx_buf + c.tx_off, c.tx_len - c.tx_off, HTTPD_SEND_FLAGS);
+		if (len < 0 && (errno == EWOULDBLOCK || errno == EINTR))
+			return;
+		if (len <= 0) {
+			hpsjam_httpd_close(c);
+			return;
+		}
+		c.tx_off += len;
+		c.ts = hpsjam_httpd_time();
+	}
+
+	free(c.tx_buf);
+	c.tx_buf = 0;
+	c.tx_len = 0;
+	c.tx_off = 0;
+
+	if (c.slot >= 0) {
+		/* let the streamer take over */
+		http_state[c.slot].ts = hpsjam_ticks - 100;
+		http_state[c.slot].fd = c.fd;
+		c.fd = -1;
+		c.slot = -1;
+	} else if (c.keep_alive == false) {
+		hpsjam_httpd_close(c);
+	} else {
+		/* the next request must be complete within the timeout */
+		c.ts = hpsjam_httpd_time();
+		hpsjam_httpd_parse(c);
+	}
 }
 
 static int
 hpsjam_httpd_do_listen(const char *host, const char *port,
     struct pollfd *pfd, int num_sock, int buffer)
 {
-	static const struct timeval timeout = {.tv_sec = 1};
+	static const int enable = 1;
 	struct addrinfo hints = {};
 	struct addrinfo *res;
 	struct addrinfo *res0;
@@ -447,11 +603,14 @@ hpsjam_httpd_do_listen(const char *host, const char *port,
 		setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &flag, (int)sizeof(flag));
 		setsockopt(s, SOL_SOCKET, SO_SNDBUF, &buffer, (int)sizeof(buffer));
 		setsockopt(s, SOL_SOCKET, SO_RCVBUF, &buffer, (int)sizeof(buffer));
-		setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &timeout, (int)sizeof(timeout));
-		setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, (int)sizeof(timeout));
+
+		if (ioctl(s, FIONBIO, &enable) != 0) {
+			close(s);
+			continue;
+		}
 
 		if (bind(s, res0->ai_addr, res0->ai_addrlen) == 0) {
-			if (listen(s, http_nstate) == 0) {
+			if (listen(s, http_nclient) == 0) {
 				if (ns < num_sock) {
 					pfd[ns++].fd = s;
 					continue;
@@ -475,79 +634,152 @@ hpsjam_httpd_buflimit()
 	return ((HPSJAM_SAMPLE_RATE / 4) * HPSJAM_CHANNELS * HPSJAM_SAMPLE_BYTES);
 };
 
+static void
+hpsjam_httpd_accept(int fd)
+{
+	static const int enable = 1;
+	struct sockaddr_storage sa;
+	socklen_t socklen;
+	size_t x;
+	int f;
+
+	for (x = 0; x != http_nclient; x++) {
+		struct http_client &c = http_client[x];
+
+		if (c.fd != -1)
+			continue;
+
+		socklen = sizeof(sa);
+		f = accept(fd, (struct sockaddr *)&sa, &socklen);
+		if (f < 0)
+			return;
+		if (ioctl(f, FIONBIO, &enable) != 0) {
+			close(f);
+			continue;
+		}
+#ifdef SO_NOSIGPIPE
+		setsockopt(f, SOL_SOCKET, SO_NOSIGPIPE, &enable, (int)sizeof(enable));
+#endif
+		c.fd = f;
+		c.slot = -1;
+		c.ts = hpsjam_httpd_time();
+		c.keep_alive = false;
+		c.rx_len = 0;
+		c.tx_buf = 0;
+		c.tx_len = 0;
+		c.tx_off = 0;
+	}
+}
+
+/*
+ * Single threaded, non-blocking event loop serving the pages and the
+ * stream headers. Established streams are written by the streamer.
+ */
 static void *
 hpsjam_httpd_server(void *arg)
 {
 	const size_t bufferlimit = hpsjam_httpd_buflimit();
 	const char *host = http_host;
 	const char *port = http_port;
-	struct sockaddr sa = {};
-	struct pollfd fds[HTTPD_BIND_MAX] = {};
+	struct pollfd *fds;
+	size_t *index;
 	int nfd;
 
+	fds = new struct pollfd [HTTPD_BIND_MAX + http_nclient];
+	index = new size_t [http_nclient];
+
 	nfd = hpsjam_httpd_do_listen(host, port, fds, HTTPD_BIND_MAX, bufferlimit);
 	if (nfd < 1)
 		errx(1, "Could not bind to '%s' and '%s'", host, port);
 
 	while (1) {
+		size_t free_slots = 0;
+		time_t now;
 		int ns = nfd;
 		int c;
-		int f;
 
-		for (c = 0; c != ns; c++) {
-			fds[c].events = (POLLIN | POLLRDNORM | POLLRDBAND | POLLPRI |
-			    POLLERR | POLLHUP | POLLNVAL);
+		for (size_t x = 0; x != http_nclient; x++) {
+			struct http_client &cl = http_client[x];
+
+			if (cl.fd == -1) {
+				free_slots++;
+				continue;
+			}
+			fds[ns].fd = cl.fd;
+			fds[ns].events = (cl.tx_buf != 0) ? POLLOUT : POLLIN;
+			fds[ns].revents = 0;
+			index[ns - nfd] = x;
+			ns++;
+		}
+
+		/* stop accepting when all client slots are busy */
+		for (c = 0; c != nfd; c++) {
+			fds[c].events = free_slots ? POLLIN : 0;
 			fds[c].revents = 0;
 		}
-		if (poll(fds, ns, -1) < 0)
+
+		if (poll(fds, ns, 1000) < 0 && errno != EINTR)
 			errx(1, "Polling failed");
 
-		for (c = 0; c != ns; c++) {
-			socklen_t socklen = sizeof(sa);
+		for (c = nfd; c != ns; c++) {
+			struct http_client &cl = http_client[index[c - nfd]];
 
 			if (fds[c].revents == 0)
 				continue;
-			f = accept(fds[c].fd, &sa, &socklen);
-			if (f < 0)
-				continue;
-			hpsjam_httpd_handle_connection(f, (const struct sockaddr_in *)&sa);
+			if (cl.tx_buf != 0)
+				hpsjam_httpd_output(cl);
+			else
+				hpsjam_httpd_input(cl);
+			/* send replies right away, if possible */
+			if (cl.fd != -1 && cl.tx_buf != 0)
+				hpsjam_httpd_output(cl);
+		}
+
+		for (c = 0; c != nfd; c++) {
+			if (fds[c].revents != 0)
+				hpsjam_httpd_accept(fds[c].fd);
+		}
+
+		/* close idle and slow connections */
+		now = hpsjam_httpd_time();
+
+		for (size_t x = 0; x != http_nclient; x++) {
+			struct http_client &cl = http_client[x];
+
+			if (cl.fd != -1 && now - cl.ts >= HTTPD_IDLE_TIMEOUT)
+				hpsjam_httpd_close(cl);
 		}
 	}
 	return (0);
 }
 
+/* called from the real-time thread, must not block */
 void
 hpsjam_httpd_streamer(const float *pleft, const float *pright, size_t samples)
 {
-	const size_t bufferlimit = hpsjam_httpd_buflimit();
-	uint8_t buf[samples][HPSJAM_CHANNELS][HPSJAM_SAMPLE_BYTES];
-	uint16_t ts;
-	size_t x;
-
-	for (x = 0; x != samples; x++) {
-		static float http_in_peak;
-
-		float left = pleft[x];
-		float right = pright[x];
+	const size_t head = http_ring.head.load(std::memory_order_relaxed);
+	const size_t tail = http_ring.tail.load(std::memory_order_acquire);
 
-		hpsjam_stereo_compressor(HPSJAM_SAMPLE_RATE,
-		    http_in_peak, left, right);
-
-		const int32_t out[2] = {
-		    (int32_t)(left * (1LL << 31)),
-		    (int32_t)(right * (1LL << 31))
-		};
+	if (HTTPD_RING_SIZE - (head - tail) < samples) {
+		http_ring.overruns.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
 
-		buf[x][0][0] = out[0] & 0xFF;
-		buf[x][0][1] = (out[0] >> 8) & 0xFF;
-		buf[x][0][2] = (out[0] >> 16) & 0xFF;
-		buf[x][0][3] = (out[0] >> 24) & 0xFF;
+	for (size_t x = 0; x != samples; x++) {
+		float *frame = http_ring.data[(head + x) % HTTPD_RING_SIZE];
 
-		buf[x][1][0] = out[1] & 0xFF;
-		buf[x][1][1] = (out[1] >> 8) & 0xFF;
-		buf[x][1][2] = (out[1] >> 16) & 0xFF;
-		buf[x][1][3] = (out[1] >> 24) & 0xFF;
+		frame[0] = pleft[x];
+		frame[1] = pright[x];
 	}
+	http_ring.head.store(head + samples, std::memory_order_release);
+}
+
+static void
+hpsjam_httpd_stream_batch(const uint8_t *buf, size_t len)
+{
+	const size_t bufferlimit = hpsjam_httpd_buflimit();
+	uint16_t ts;
+	size_t x;
 
 	/* get current ticks */
 	ts = hpsjam_ticks;
@@ -582,9 +814,9 @@ hpsjam_httpd_streamer(const float *pleft, const float *pright, size_t samples)
 			   ) {
 			http_state[x].fd = -1;
 			close(fd);
-		} else if ((ssize_t)(bufferlimit - write_len) < (ssize_t)sizeof(buf)) {
+		} else if ((ssize_t)(bufferlimit - write_len) < (ssize_t)len) {
 			/* do nothing */
-		} else if (write(fd, buf, sizeof(buf)) != (ssize_t)sizeof(buf)) {
+		} else if (send(fd, buf, len, HTTPD_SEND_FLAGS) != (ssize_t)len) {
 			http_state[x].fd = -1;
 			close(fd);
 		} else {
@@ -594,6 +826,65 @@ hpsjam_httpd_streamer(const float *pleft, const float *pright, size_t samples)
 	}
 }
 
+/*
+ * Drain the ring in batches, so that the socket system calls
+ * happen at a low rate and outside the real-time thread.
+ */
+static void *
+hpsjam_httpd_stream_loop(void *arg)
+{
+	static hpsjam_limiter http_limiter;
+	static uint8_t buf[HTTPD_BATCH][HPSJAM_CHANNELS][HPSJAM_SAMPLE_BYTES];
+	static float left[HTTPD_BATCH];
+	static float right[HTTPD_BATCH];
+
+	hpsjam_denormal_disable();
+
+	while (1) {
+		const size_t tail = http_ring.tail.load(std::memory_order_relaxed);
+		const size_t head = http_ring.head.load(std::memory_order_acquire);
+		size_t x;
+
+		if (head - tail < HTTPD_BATCH) {
+			/* wait for the rest of the batch, but at least 1 ms */
+			usleep(((HTTPD_BATCH - (head - tail)) * 1000000ULL) /
+			    HPSJAM_SAMPLE_RATE + 1000);
+			continue;
+		}
+
+		for (x = 0; x != HTTPD_BATCH; x++) {
+			const float *frame = http_ring.data[(tail + x) % HTTPD_RING_SIZE];
+
+			left[x] = frame[0];
+			right[x] = frame[1];
+		}
+		http_ring.tail.store(tail + HTTPD_BATCH, std::memory_order_release);
+
+		/* latency is not critical, use look-ahead */
+		http_limiter.doit(HPSJAM_SAMPLE_RATE, left, right, HTTPD_BATCH);
+
+		for (x = 0; x != HTTPD_BATCH; x++) {
+			const int32_t out[2] = {
+			    (int32_t)(left[x] * (1LL << 31)),
+			    (int32_t)(right[x] * (1LL << 31))
+			};
+
+			buf[x][0][0] = out[0] & 0xFF;
+			buf[x][0][1] = (out[0] >> 8) & 0xFF;
+			buf[x][0][2] = (out[0] >> 16) & 0xFF;
+			buf[x][0][3] = (out[0] >> 24) & 0xFF;
+
+			buf[x][1][0] = out[1] & 0xFF;
+			buf[x][1][1] = (out[1] >> 8) & 0xFF;
+			buf[x][1][2] = (out[1] >> 16) & 0xFF;
+			buf[x][1][3] = (out[1] >> 24) & 0xFF;
+		}
+
+		hpsjam_httpd_stream_batch(&buf[0][0][0], sizeof(buf));
+	}
+	return (0);
+}
+
 void
 hpsjam_httpd_start()
 {
@@ -610,6 +901,17 @@ hpsjam_httpd_start()
 		http_state[x].ts = 0;
 	}
 
+	http_client = new struct http_client [http_nclient];
+	assert(http_client != 0);
+
+	for (size_t x = 0; x != http_nclient; x++) {
+		http_client[x].fd = -1;
+		http_client[x].slot = -1;
+		http_client[x].tx_buf = 0;
+	}
+
 	if (pthread_create(&td, 0, hpsjam_httpd_server, 0))
 		errx(1, "Could not create HTTP daemon thread");
+	if (pthread_create(&td, 0, hpsjam_httpd_stream_loop, 0))
+		errx(1, "Could not create HTTP streaming thread");
 }
@@ -29,6 +29,7 @@
 #include <sys/types.h>
 
 extern size_t http_nstate;
+extern size_t http_nclient;
 extern const char * http_host;
 extern const char * http_port;
 
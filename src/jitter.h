@@ -41,8 +41,10 @@ struct hpsjam_jitter {
 	float stats[HPSJAM_MAX_JITTER];
 	uint64_t packet_recover;
 	uint64_t packet_damage;
+	uint64_t target_damage;
 	uint16_t counter;
 	uint16_t jitter_ticks;
+	uint16_t target_bonus;
 
 	void clear() {
 		memset(this, 0, sizeof(*this));
@@ -86,6 +88,58 @@ struct hpsjam_jitter {
 		}
 	};
 
+	/*
+	 * Get the shortest span of ticks covering the given percentage
+	 * of the received packets, or a negative value if not ready.
+	 */
+	int get_spread_in_ms(unsigned percent) const {
+		float total = 0.0f;
+		unsigned best = HPSJAM_MAX_JITTER;
+
+		for (uint8_t x = 0; x != HPSJAM_MAX_JITTER; x++)
+			total += stats[x];
+		if (total < 1.0f)
+			return (-1);
+
+		const float need = (total * percent) / 100.0f;
+
+		for (unsigned start = 0; start != HPSJAM_MAX_JITTER; start++) {
+			float sum = 0.0f;
+			unsigned len;
+
+			for (len = 0; len != best; len++) {
+				sum += stats[(start + len) % HPSJAM_MAX_JITTER];
+				if (sum >= need)
+					break;
+			}
+			if (len < best)
+				best = len;
+		}
+		return (best);
+	};
+
+	/*
+	 * Get a jitter buffer target from the spread at the given
+	 * percentile. Damaged frames since the last call increase
+	 * the target, which then slowly decays. Must be called
+	 * periodically.
+	 */
+	int get_target_in_ms(unsigned percent) {
+		const int spread = get_spread_in_ms(percent);
+
+		if (target_damage != packet_damage) {
+			target_damage = packet_damage;
+			if (target_bonus < HPSJAM_MAX_JITTER / 4)
+				target_bonus += 2;
+		} else if (target_bonus != 0) {
+			target_bonus--;
+		}
+
+		if (spread < 0)
+			return (-1);
+		return (2 * spread + 2 + target_bonus);
+	};
+
 	void rx_recover() {
 		packet_recover++;
 	};
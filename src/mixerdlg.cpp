@@ -100,6 +100,8 @@ HpsJamSlider :: HpsJamSlider()
 	gain = 0;
 	level[0] = 0;
 	level[1] = 0;
+	rms[0] = 0;
+	rms[1] = 0;
 	active = false;
 	setMinimumSize(dsize, 128);
 	setMaximumSize(65535,65535);
@@ -164,6 +166,16 @@ HpsJamSlider :: setLevel(float _left, float _right)
 	}
 }
 
+void
+HpsJamSlider :: setRMS(float _left, float _right)
+{
+	if (_left != rms[0] || _right != rms[1]) {
+		rms[0] = _left;
+		rms[1] = _right;
+		update();
+	}
+}
+
 void
 HpsJamSlider :: adjustGain(int delta)
 {
@@ -246,6 +258,15 @@ HpsJamSlider :: paintEvent(QPaintEvent *event)
 		paint.drawPoint(QPoint(width() / 2 + dsize / 2, height() - x * dsize - dsize / 2));
 	}
 
+	/* mark the RMS levels */
+	for (unsigned x = 0; x != 2; x++) {
+		const unsigned rdots = dots * rms[x];
+		if (rdots == 0)
+			continue;
+		paint.fillRect(QRect(width() / 2 - dsize + x * dsize,
+		    height() - rdots * dsize, dsize, 2), fg);
+	}
+
 	target = QRect(2, (1.0f - value) * (height() - dsize), width() - 4, dsize);
 
 	paint.setPen(QPen(fg, 2));
@@ -529,6 +550,25 @@ HpsJamMixer :: handle_fader_level(uint8_t mix, uint8_t index, float left, float
 	}
 }
 
+void
+HpsJamMixer :: handle_fader_rms(uint8_t mix, uint8_t index, float left, float right)
+{
+	/* make scale logarithmic */
+	left = level_encode(left);
+	right = level_encode(right);
+
+	switch (mix) {
+	case 0:
+		HPSJAM_NO_SIGNAL(peer_strip[index].w_slider,setRMS(left, right));
+		break;
+	case 255:
+		HPSJAM_NO_SIGNAL(self_strip.w_slider,setRMS(left, right));
+		break;
+	default:
+		break;
+	}
+}
+
 void
 HpsJamMixer :: handle_fader_self(uint8_t mix, uint8_t index)
 {
@@ -656,8 +696,8 @@ HpsJamMixer :: handle_bits_changed(int id)
 	bits = peer_strip[id].getBits();
 
 	ptr = new struct hpsjam_packet_entry;
-	ptr->packet.type = HPSJAM_TYPE_FADER_BITS_REQUEST;
-	ptr->packet.setFaderData(0, id, &bits, 1);
+	ptr->data->packet.type = HPSJAM_TYPE_FADER_BITS_REQUEST;
+	ptr->data->packet.setFaderData(0, id, &bits, 1);
 
 	hpsjam_client_peer->send_single_pkt(ptr);
 }
@@ -671,8 +711,8 @@ HpsJamMixer :: handle_gain_changed(int id)
 	gain = peer_strip[id].w_slider.value;
 
 	ptr = new struct hpsjam_packet_entry;
-	ptr->packet.type = HPSJAM_TYPE_FADER_GAIN_REQUEST;
-	ptr->packet.setFaderValue(0, id, &gain, 1);
+	ptr->data->packet.type = HPSJAM_TYPE_FADER_GAIN_REQUEST;
+	ptr->data->packet.setFaderValue(0, id, &gain, 1);
 
 	hpsjam_client_peer->send_single_pkt(ptr);
 }
@@ -686,8 +726,8 @@ HpsJamMixer :: handle_pan_changed(int id)
 	pan = peer_strip[id].w_slider.pan;
 
 	ptr = new struct hpsjam_packet_entry;
-	ptr->packet.type = HPSJAM_TYPE_FADER_PAN_REQUEST;
-	ptr->packet.setFaderValue(0, id, &pan, 1);
+	ptr->data->packet.type = HPSJAM_TYPE_FADER_PAN_REQUEST;
+	ptr->data->packet.setFaderValue(0, id, &pan, 1);
 
 	hpsjam_client_peer->send_single_pkt(ptr);
 }
@@ -702,8 +742,8 @@ HpsJamMixer :: handle_eq_changed(int id)
 		return;
 
 	ptr = new struct hpsjam_packet_entry;
-	ptr->packet.type = HPSJAM_TYPE_FADER_EQ_REQUEST;
-	ptr->packet.setFaderData(0, id, eq.constData(), eq.length());
+	ptr->data->packet.type = HPSJAM_TYPE_FADER_EQ_REQUEST;
+	ptr->data->packet.setFaderData(0, id, eq.constData(), eq.length());
 
 	hpsjam_client_peer->send_single_pkt(ptr);
 }
@@ -714,7 +754,7 @@ HpsJamMixer :: handle_local_eq_changed()
 	QByteArray eq = self_strip.w_eq.edit.toPlainText().toLatin1();
 
 	QMutexLocker locker(&hpsjam_client_peer->lock);
-	hpsjam_client_peer->local_eq.init(eq.constData());
+	hpsjam_client_peer->local_eq->init(eq.constData());
 }
 
 void
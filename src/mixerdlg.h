@@ -78,6 +78,7 @@ public:
 	float value;
 	float pan;
 	float level[2];
+	float rms[2];
 	int gain;
 
 	void setValue(float);
@@ -86,6 +87,7 @@ public:
 	void adjustPan(float);
 	void adjustGain(int);
 	void setLevel(float, float);
+	void setRMS(float, float);
 
 	void paintEvent(QPaintEvent *);
         void mousePressEvent(QMouseEvent *);
@@ -164,6 +166,7 @@ public:
 		HPSJAM_NO_SIGNAL(w_slider,setValue(1));
 		HPSJAM_NO_SIGNAL(w_slider,setPan(0));
 		HPSJAM_NO_SIGNAL(w_slider,setLevel(0,0));
+		HPSJAM_NO_SIGNAL(w_slider,setRMS(0,0));
 		HPSJAM_NO_SIGNAL(w_slider,setGain(0));
 		w_eq.handle_disable();
 		HPSJAM_NO_SIGNAL(b_inv,setFlat(false));
@@ -305,6 +308,7 @@ public:
 
 public slots:
 	void handle_fader_level(uint8_t, uint8_t, float, float);
+	void handle_fader_rms(uint8_t, uint8_t, float, float);
 	void handle_fader_name(uint8_t, uint8_t, QString *);
 	void handle_fader_icon(uint8_t, uint8_t, QByteArray *);
 	void handle_fader_gain(uint8_t, uint8_t, float);
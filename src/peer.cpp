@@ -34,25 +34,82 @@
 #include "chatdlg.h"
 #include "lyricsdlg.h"
 #include "httpd.h"
+#include "denormal.h"
 
 #include "timer.h"
 
-#define	HPSJAM_ADJUST_TICKS 0x3fff	/* ticks */
+#include <stdio.h>
+
+#define	HPSJAM_ADJUST_TICKS 0x0fff	/* ticks */
+#define	HPSJAM_PORT_ORDER_TICKS 0x3fff	/* ticks */
+
+#define	HPSJAM_INPUT_POOL_MAX 16	/* free input packetizers to keep */
+
+static QMutex hpsjam_input_pool_lock;
+static struct hpsjam_input_packetizer *hpsjam_input_pool[HPSJAM_INPUT_POOL_MAX];
+static unsigned hpsjam_input_pool_free;
+static unsigned hpsjam_input_pool_used;
+
+/* input packetizers are large, so only keep them for connected peers */
+struct hpsjam_input_packetizer *
+hpsjam_input_pkt_alloc()
+{
+	struct hpsjam_input_packetizer *retval;
+
+	QMutexLocker locker(&hpsjam_input_pool_lock);
+
+	if (hpsjam_input_pool_free != 0)
+		retval = hpsjam_input_pool[--hpsjam_input_pool_free];
+	else
+		retval = new struct hpsjam_input_packetizer;
+	hpsjam_input_pool_used++;
+
+	retval->init();
+	return (retval);
+}
+
+void
+hpsjam_input_pkt_free(struct hpsjam_input_packetizer *ptr)
+{
+	if (ptr == 0)
+		return;
+
+	QMutexLocker locker(&hpsjam_input_pool_lock);
+
+	hpsjam_input_pool_used--;
+	if (hpsjam_input_pool_free != HPSJAM_INPUT_POOL_MAX)
+		hpsjam_input_pool[hpsjam_input_pool_free++] = ptr;
+	else
+		delete ptr;
+}
 
 template <typename T>
 void HpsJamSendPortOrderRequest(T &s)
 {
 	if (s.output_pkt.find(HPSJAM_TYPE_SET_PORT_ORDER_REQUEST) == 0) {
 		struct hpsjam_packet_entry *pkt = new struct hpsjam_packet_entry;
-		pkt->packet.setPortOrder(s.input_pkt);
-		pkt->packet.type = HPSJAM_TYPE_SET_PORT_ORDER_REQUEST;
+		pkt->data->packet.setPortOrder(*s.input_pkt);
+		pkt->data->packet.type = HPSJAM_TYPE_SET_PORT_ORDER_REQUEST;
 		pkt->insert_tail(&s.output_pkt.head);
 	}
 }
 
+template <typename T>
+void HpsJamAdaptWaterTarget(T &s)
+{
+	if (hpsjam_jitter_percentile == 0)
+		return;
+
+	const int target = s.input_pkt->jitter.get_target_in_ms(hpsjam_jitter_percentile);
+	if (target < 0)
+		return;
+
+	s.in_audio.setWaterTarget(target);
+}
+
 Q_DECL_EXPORT void
 hpsjam_peer_receive(const struct hpsjam_socket_address &src,
-    const struct hpsjam_socket_address &dst, const union hpsjam_frame &frame)
+    const struct hpsjam_socket_address &dst, const union hpsjam_frame &frame, size_t len)
 {
 	if (hpsjam_num_server_peers == 0) {
 		QMutexLocker locker(&hpsjam_client_peer->lock);
@@ -60,7 +117,7 @@ hpsjam_peer_receive(const struct hpsjam_socket_address &src,
 		if (hpsjam_client_peer->address[0].valid()) {
 			for (unsigned i = 0; i != HPSJAM_PORTS_MAX; i++) {
 				if (hpsjam_client_peer->address[i] == src) {
-					hpsjam_client_peer->input_pkt.receive(frame);
+					hpsjam_client_peer->input_pkt->receive(frame, len);
 					break;
 				}
 			}
@@ -74,7 +131,7 @@ hpsjam_peer_receive(const struct hpsjam_socket_address &src,
 			QMutexLocker locker(&peer.lock);
 
 			if (peer.valid && peer.address[0] == src) {
-				peer.input_pkt.receive(frame);
+				peer.input_pkt->receive(frame, len);
 				return;
 			}
 		}
@@ -137,7 +194,12 @@ hpsjam_peer_receive(const struct hpsjam_socket_address &src,
 			delete [] peer.eq_data;
 			peer.eq_data = 0;
 			peer.eq_size = 0;
-			peer.input_pkt.receive(frame);
+			hpsjam_equalizer_switch_free(peer.eq);
+			peer.eq = 0;
+			if (hpsjam_server_processing)
+				peer.eq = new class hpsjam_equalizer_switch;
+			peer.input_pkt = hpsjam_input_pkt_alloc();
+			peer.input_pkt->receive(frame, len);
 			peer.send_welcome_message();
 			peer.send_mixer_parameters();
 
@@ -157,7 +219,7 @@ hpsjam_peer_receive(const struct hpsjam_socket_address &src,
 
 static void
 hpsjam_server_broadcast(const struct hpsjam_packet_entry &entry,
-    class hpsjam_server_peer *except = 0, bool single = false)
+    class hpsjam_server_peer *except = 0)
 {
 	struct hpsjam_packet_entry *ptr;
 
@@ -171,12 +233,8 @@ hpsjam_server_broadcast(const struct hpsjam_packet_entry &entry,
 		if (peer.valid == false)
 			continue;
 
-		/* check if a level packet is already pending */
-		if (single && peer.output_pkt.find(entry.packet.type))
-			continue;
-		/* duplicate packet */
-		ptr = new struct hpsjam_packet_entry;
-		*ptr = entry;
+		/* share payload */
+		ptr = new struct hpsjam_packet_entry(entry.data);
 		ptr->insert_tail(&peer.output_pkt.head);
 	}
 }
@@ -368,9 +426,34 @@ hpsjam_client_peer :: midi_process(uint8_t *buffer)
 	return (retval);
 }
 
+static void
+hpsjam_process_pan(float *left, float *right, float pan, size_t samples)
+{
+	if (pan < 0.0f) {
+		const float g[3] = { 1.0f + pan, 2.0f + pan, - pan };
+		for (size_t x = 0; x != samples; x++) {
+			float l = (left[x] * g[1] + right[x] * g[2]) / 2.0f;
+			float r = right[x] * g[0];
+
+			left[x] = l;
+			right[x] = r;
+		}
+	} else if (pan > 0.0f) {
+		const float g[3] = { 1.0f - pan, 2.0f - pan, pan };
+		for (size_t x = 0; x != samples; x++) {
+			float l = left[x] * g[0];
+			float r = (right[x] * g[1] + left[x] * g[2]) / 2.0f;
+
+			left[x] = l;
+			right[x] = r;
+		}
+	}
+}
+
 void
 hpsjam_client_peer :: sound_process(float *left, float *right, size_t samples)
 {
+	hpsjam_denormal_guard denormal;
 	QMutexLocker locker(&lock);
 
 	if (address[0].valid() == false) {
@@ -392,10 +475,8 @@ hpsjam_client_peer :: sound_process(float *left, float *right, size_t samples)
 
 		if (hpsjam_client->pullPlayback(left, right, samples) && effects) {
 			/* May need compressor */
-			for (size_t x = 0; x != samples; x++) {
-				hpsjam_stereo_compressor(HPSJAM_SAMPLE_RATE,
-				    local_peak, left[x], right[x]);
-			}
+			hpsjam_block_compressor(HPSJAM_SAMPLE_RATE,
+			    local_peak, left, right, samples);
 		}
 		return;
 	}
@@ -420,28 +501,10 @@ hpsjam_client_peer :: sound_process(float *left, float *right, size_t samples)
 	hpsjam_client->pullPlayback(left, right, samples);
 
 	/* Process equalizer */
-	eq.doit(left, right, samples);
+	eq->doit(left, right, samples);
 
 	/* Process panning */
-	if (in_pan < 0.0f) {
-		const float g[3] = { 1.0f + in_pan, 2.0f + in_pan, - in_pan };
-		for (size_t x = 0; x != samples; x++) {
-			float l = (left[x] * g[1] + right[x] * g[2]) / 2.0f;
-			float r = right[x] * g[0];
-
-			left[x] = l;
-			right[x] = r;
-		}
-	} else if (in_pan > 0.0f) {
-		const float g[3] = { 1.0f - in_pan, 2.0f - in_pan, in_pan };
-		for (size_t x = 0; x != samples; x++) {
-			float l = left[x] * g[0];
-			float r = (right[x] * g[1] + left[x] * g[2]) / 2.0f;
-
-			left[x] = l;
-			right[x] = r;
-		}
-	}
+	hpsjam_process_pan(left, right, in_pan, samples);
 
 	/* Process gain */
 	if (in_gain < 1.0f) {
@@ -452,16 +515,12 @@ hpsjam_client_peer :: sound_process(float *left, float *right, size_t samples)
 	}
 
 	/* Process compressor */
-	for (size_t x = 0; x != samples; x++) {
-		hpsjam_stereo_compressor(HPSJAM_SAMPLE_RATE,
-		    in_peak, left[x], right[x]);
-	}
+	hpsjam_block_compressor(HPSJAM_SAMPLE_RATE,
+	    in_peak, left, right, samples);
 
-	out_audio[0].addSamples(left, samples);
-	out_audio[1].addSamples(right, samples);
+	out_audio.addSamples(left, right, samples);
 
-	in_audio[0].remSamples(left, samples);
-	in_audio[1].remSamples(right, samples);
+	in_audio.remSamples(left, right, samples);
 
 	/* Process bits */
 	if (bits & HPSJAM_BIT_SOLO) {
@@ -470,7 +529,7 @@ hpsjam_client_peer :: sound_process(float *left, float *right, size_t samples)
 	}
 
 	/* Process local equalizer */
-	local_eq.doit(temp_l, temp_r, samples);
+	local_eq->doit(temp_l, temp_r, samples);
 
 	/* Balance fader */
 	const float mg[2] = {
@@ -523,10 +582,8 @@ hpsjam_client_peer :: sound_process(float *left, float *right, size_t samples)
 		hpsjam_httpd_streamer(left, right, samples);
 #endif
 	/* Process final compressor */
-	for (size_t x = 0; x != samples; x++) {
-		hpsjam_stereo_compressor(HPSJAM_SAMPLE_RATE,
-		    local_peak, left[x], right[x]);
-	}
+	hpsjam_block_compressor(HPSJAM_SAMPLE_RATE,
+	    local_peak, left, right, samples);
 
 	hpsjam_client->pushRecord(left, right, samples);
 }
@@ -544,8 +601,8 @@ hpsjam_server_peer :: handle_pending_watchdog()
 
 	if (address[0].valid() && output_pkt.empty()) {
 		struct hpsjam_packet_entry *pkt = new struct hpsjam_packet_entry;
-		pkt->packet.setPing(0, hpsjam_ticks, 0, 0);
-		pkt->packet.type = HPSJAM_TYPE_PING_REQUEST;
+		pkt->data->packet.setPing(0, hpsjam_ticks, 0, 0);
+		pkt->data->packet.type = HPSJAM_TYPE_PING_REQUEST;
 		pkt->insert_tail(&output_pkt.head);
 	}
 }
@@ -561,37 +618,40 @@ hpsjam_server_peer :: handle_pending_timeout()
 
 	/* tell other clients about disconnect */
 	pkt = new struct hpsjam_packet_entry;
-	pkt->packet.setFaderData(0, serverID(), 0, 0);
-	pkt->packet.type = HPSJAM_TYPE_FADER_DISCONNECT_REPLY;
+	pkt->data->packet.setFaderData(0, serverID(), 0, 0);
+	pkt->data->packet.type = HPSJAM_TYPE_FADER_DISCONNECT_REPLY;
 	hpsjam_server_broadcast(*pkt, this);
 	delete pkt;
 }
 
+/* a NULL right channel means the audio is already mono */
 template <typename T>
 void HpsJamProcessOutputAudio(T &s, float *left, float *right)
 {
-	/* check if we should downsample to mono */
-	switch (s.output_fmt) {
-	case HPSJAM_TYPE_AUDIO_8_BIT_1CH:
-	case HPSJAM_TYPE_AUDIO_16_BIT_1CH:
-	case HPSJAM_TYPE_AUDIO_24_BIT_1CH:
-	case HPSJAM_TYPE_AUDIO_32_BIT_1CH:
-		for (unsigned int x = 0; x != HPSJAM_DEF_SAMPLES; x++)
-			left[x] = right[x] = (left[x] + right[x]) / 2.0f;
-		break;
-	default:
-		break;
-	}
+	if (hpsjam_audio_format_is_mono(s.output_fmt)) {
+		/* check if we should downsample to mono */
+		if (right != 0) {
+			for (unsigned int x = 0; x != HPSJAM_DEF_SAMPLES; x++)
+				left[x] = (left[x] + right[x]) / 2.0f;
+		}
+
+		/* run compressor */
+		hpsjam_block_compressor(HPSJAM_SAMPLE_RATE,
+		    s.out_peak, left, 0, HPSJAM_DEF_SAMPLES);
 
-	/* run compressor */
-	for (unsigned int x = 0; x != HPSJAM_DEF_SAMPLES; x++) {
-		hpsjam_stereo_compressor(HPSJAM_SAMPLE_RATE,
-		    s.out_peak, left[x], right[x]);
+		/* add samples to final output buffer */
+		s.out_buffer.setChannels(1);
+		s.out_buffer.addSamples(left, 0, HPSJAM_DEF_SAMPLES);
+		return;
 	}
 
+	/* run compressor, the buffer duplicates mono audio */
+	hpsjam_block_compressor(HPSJAM_SAMPLE_RATE,
+	    s.out_peak, left, right, HPSJAM_DEF_SAMPLES);
+
 	/* add samples to final output buffer */
-	s.out_buffer[0].addSamples(left, HPSJAM_DEF_SAMPLES);
-	s.out_buffer[1].addSamples(right, HPSJAM_DEF_SAMPLES);
+	s.out_buffer.setChannels(2);
+	s.out_buffer.addSamples(left, right, HPSJAM_DEF_SAMPLES);
 }
 
 static uint8_t hpsjam_midi_data[16];
@@ -600,13 +660,13 @@ static size_t hpsjam_midi_bufsize;
 template <typename T>
 void HpsJamSendPacket(T &s)
 {
-	struct hpsjam_packet_entry entry;
+	struct hpsjam_packet_data entry;
 	float temp[2][HPSJAM_NOM_SAMPLES];
 
 	/* append MIDI data, if any */
 	if (hpsjam_midi_bufsize != 0) {
 		entry.packet.putMidiData(hpsjam_midi_data, hpsjam_midi_bufsize);
-		s.output_pkt.append_pkt(entry);
+		s.output_pkt.append_pkt(entry.packet);
 	}
 
 	/* check if we are sending XOR data */
@@ -614,46 +674,46 @@ void HpsJamSendPacket(T &s)
 		goto done;
 
 	/* get back correct amount of samples */
-	s.out_buffer[0].remSamples(temp[0], HPSJAM_NOM_SAMPLES);
-	s.out_buffer[1].remSamples(temp[1], HPSJAM_NOM_SAMPLES);
+	s.out_buffer.remSamples(temp[0], hpsjam_audio_format_is_mono(s.output_fmt) ?
+	    0 : temp[1], HPSJAM_NOM_SAMPLES);
 
 	/* select output format */
 	switch (s.output_fmt) {
 	case HPSJAM_TYPE_AUDIO_8_BIT_1CH:
 		entry.packet.put8Bit1ChSample(temp[0], HPSJAM_NOM_SAMPLES);
-		s.output_pkt.append_pkt(entry);
+		s.output_pkt.append_pkt(entry.packet);
 		break;
 	case HPSJAM_TYPE_AUDIO_16_BIT_1CH:
 		entry.packet.put16Bit1ChSample(temp[0], HPSJAM_NOM_SAMPLES);
-		s.output_pkt.append_pkt(entry);
+		s.output_pkt.append_pkt(entry.packet);
 		break;
 	case HPSJAM_TYPE_AUDIO_24_BIT_1CH:
 		entry.packet.put24Bit1ChSample(temp[0], HPSJAM_NOM_SAMPLES);
-		s.output_pkt.append_pkt(entry);
+		s.output_pkt.append_pkt(entry.packet);
 		break;
 	case HPSJAM_TYPE_AUDIO_32_BIT_1CH:
 		entry.packet.put32Bit1ChSample(temp[0], HPSJAM_NOM_SAMPLES);
-		s.output_pkt.append_pkt(entry);
+		s.output_pkt.append_pkt(entry.packet);
 		break;
 	case HPSJAM_TYPE_AUDIO_8_BIT_2CH:
 		entry.packet.put8Bit2ChSample(temp[0], temp[1], HPSJAM_NOM_SAMPLES);
-		s.output_pkt.append_pkt(entry);
+		s.output_pkt.append_pkt(entry.packet);
 		break;
 	case HPSJAM_TYPE_AUDIO_16_BIT_2CH:
 		entry.packet.put16Bit2ChSample(temp[0], temp[1], HPSJAM_NOM_SAMPLES);
-		s.output_pkt.append_pkt(entry);
+		s.output_pkt.append_pkt(entry.packet);
 		break;
 	case HPSJAM_TYPE_AUDIO_24_BIT_2CH:
 		entry.packet.put24Bit2ChSample(temp[0], temp[1], HPSJAM_NOM_SAMPLES);
-		s.output_pkt.append_pkt(entry);
+		s.output_pkt.append_pkt(entry.packet);
 		break;
 	case HPSJAM_TYPE_AUDIO_32_BIT_2CH:
 		entry.packet.put32Bit2ChSample(temp[0], temp[1], HPSJAM_NOM_SAMPLES);
-		s.output_pkt.append_pkt(entry);
+		s.output_pkt.append_pkt(entry.packet);
 		break;
 	default:
 		entry.packet.putSilence(HPSJAM_NOM_SAMPLES);
-		s.output_pkt.append_pkt(entry);
+		s.output_pkt.append_pkt(entry.packet);
 		break;
 	}
 done:
@@ -679,68 +739,75 @@ bool HpsJamReceiveUnSequenced(T &s, const struct hpsjam_packet *ptr, float *temp
 	case HPSJAM_TYPE_AUDIO_8_BIT_1CH:
 		num = ptr->get8Bit1ChSample(temp);
 		assert(num <= HPSJAM_MAX_PKT);
-		s.in_audio[0].addSamples(temp, num);
-		s.in_audio[1].addSamples(temp, num);
+		s.in_audio.setChannels(1);
+		s.in_audio.addSamples(temp, 0, num);
 		s.in_level[0].addSamples(temp, num);
-		s.in_level[1].addSamples(temp, num);
+		s.in_level[1] = s.in_level[0];
 		return (true);
 	case HPSJAM_TYPE_AUDIO_16_BIT_1CH:
 		num = ptr->get16Bit1ChSample(temp);
 		assert(num <= HPSJAM_MAX_PKT);
-		s.in_audio[0].addSamples(temp, num);
-		s.in_audio[1].addSamples(temp, num);
+		s.in_audio.setChannels(1);
+		s.in_audio.addSamples(temp, 0, num);
 		s.in_level[0].addSamples(temp, num);
-		s.in_level[1].addSamples(temp, num);
+		s.in_level[1] = s.in_level[0];
 		return (true);
 	case HPSJAM_TYPE_AUDIO_24_BIT_1CH:
 		num = ptr->get24Bit1ChSample(temp);
 		assert(num <= HPSJAM_MAX_PKT);
-		s.in_audio[0].addSamples(temp, num);
-		s.in_audio[1].addSamples(temp, num);
+		s.in_audio.setChannels(1);
+		s.in_audio.addSamples(temp, 0, num);
 		s.in_level[0].addSamples(temp, num);
-		s.in_level[1].addSamples(temp, num);
+		s.in_level[1] = s.in_level[0];
 		return (true);
 	case HPSJAM_TYPE_AUDIO_32_BIT_1CH:
 		num = ptr->get32Bit1ChSample(temp);
 		assert(num <= HPSJAM_MAX_PKT);
-		s.in_audio[0].addSamples(temp, num);
-		s.in_audio[1].addSamples(temp, num);
+		s.in_audio.setChannels(1);
+		s.in_audio.addSamples(temp, 0, num);
 		s.in_level[0].addSamples(temp, num);
-		s.in_level[1].addSamples(temp, num);
+		s.in_level[1] = s.in_level[0];
 		return (true);
 	case HPSJAM_TYPE_AUDIO_8_BIT_2CH:
 		num = ptr->get8Bit2ChSample(temp, temp + (HPSJAM_MAX_PKT / 2));
 		assert(num <= (HPSJAM_MAX_PKT / 2));
-		s.in_audio[0].addSamples(temp, num);
-		s.in_audio[1].addSamples(temp + (HPSJAM_MAX_PKT / 2), num);
+		s.in_audio.setChannels(2);
+		s.in_audio.addSamples(temp, temp + (HPSJAM_MAX_PKT / 2), num);
 		s.in_level[0].addSamples(temp, num);
 		s.in_level[1].addSamples(temp + (HPSJAM_MAX_PKT / 2), num);
 		return (true);
 	case HPSJAM_TYPE_AUDIO_16_BIT_2CH:
 		num = ptr->get16Bit2ChSample(temp, temp + (HPSJAM_MAX_PKT / 2));
 		assert(num <= (HPSJAM_MAX_PKT / 2));
-		s.in_audio[0].addSamples(temp, num);
-		s.in_audio[1].addSamples(temp + (HPSJAM_MAX_PKT / 2), num);
+		s.in_audio.setChannels(2);
+		s.in_audio.addSamples(temp, temp + (HPSJAM_MAX_PKT / 2), num);
 		s.in_level[0].addSamples(temp, num);
 		s.in_level[1].addSamples(temp + (HPSJAM_MAX_PKT / 2), num);
 		return (true);
 	case HPSJAM_TYPE_AUDIO_24_BIT_2CH:
 		num = ptr->get24Bit2ChSample(temp, temp + (HPSJAM_MAX_PKT / 2));
 		assert(num <= (HPSJAM_MAX_PKT / 2));
-		s.in_audio[0].addSamples(temp, num);
-		s.in_audio[1].addSamples(temp + (HPSJAM_MAX_PKT / 2), num);
+		s.in_audio.setChannels(2);
+		s.in_audio.addSamples(temp, temp + (HPSJAM_MAX_PKT / 2), num);
 		s.in_level[0].addSamples(temp, num);
 		s.in_level[1].addSamples(temp + (HPSJAM_MAX_PKT / 2), num);
 		return (true);
 	case HPSJAM_TYPE_AUDIO_32_BIT_2CH:
 		num = ptr->get32Bit2ChSample(temp, temp + (HPSJAM_MAX_PKT / 2));
 		assert(num <= (HPSJAM_MAX_PKT / 2));
-		s.in_audio[0].addSamples(temp, num);
-		s.in_audio[1].addSamples(temp + (HPSJAM_MAX_PKT / 2), num);
+		s.in_audio.setChannels(2);
+		s.in_audio.addSamples(temp, temp + (HPSJAM_MAX_PKT / 2), num);
 		s.in_level[0].addSamples(temp, num);
 		s.in_level[1].addSamples(temp + (HPSJAM_MAX_PKT / 2), num);
 		return (true);
-	case HPSJAM_TYPE_AUDIO_32_BIT_2CH + 1 ... HPSJAM_TYPE_AUDIO_MAX:
+	case HPSJAM_TYPE_AUDIO_32_BIT_2CH + 1 ... HPSJAM_TYPE_FADER_RMS_TELEMETRY - 1:
+	case HPSJAM_TYPE_AUDIO_MAX:
+		return (true);
+	case HPSJAM_TYPE_FADER_LEVEL_TELEMETRY:
+		s.receive_levels(ptr);
+		return (true);
+	case HPSJAM_TYPE_FADER_RMS_TELEMETRY:
+		s.receive_rms_levels(ptr);
 		return (true);
 	case HPSJAM_TYPE_MIDI_PACKET:
 		num = HPSJAM_MAX_PKT * sizeof(temp[0]);
@@ -749,13 +816,19 @@ bool HpsJamReceiveUnSequenced(T &s, const struct hpsjam_packet *ptr, float *temp
 		return (true);
 	case HPSJAM_TYPE_AUDIO_SILENCE:
 		num = ptr->getSilence();
-		s.in_audio[0].addSilence(num);
-		s.in_audio[1].addSilence(num);
+		s.in_audio.addSilence(num);
+		return (true);
+	case HPSJAM_TYPE_AUDIO_LOSS:
+		num = ptr->getSilence();
+		s.in_audio.addConcealment(num);
 		return (true);
 	case HPSJAM_TYPE_ACK:
-		/* check if other side received packet */
-		if (ptr->getPeerSeqNo() == s.output_pkt.pend_seqno)
-			s.output_pkt.advance();
+		/* check if other side received packets */
+		s.output_pkt.ack(ptr->getPeerSeqNo());
+		return (true);
+	case HPSJAM_TYPE_SELECTIVE_ACK:
+		if (ptr->length >= 2)
+			s.output_pkt.selective_ack(ptr->getPeerSeqNo(), ptr->getS32(0));
 		return (true);
 	default:
 		return (false);
@@ -765,282 +838,326 @@ bool HpsJamReceiveUnSequenced(T &s, const struct hpsjam_packet *ptr, float *temp
 static unsigned hpsjam_server_adjust[3];
 
 void
-hpsjam_server_peer :: audio_export()
+hpsjam_server_peer :: receive_sequenced(const struct hpsjam_packet *ptr)
 {
-	const union hpsjam_frame *pkt;
-	const struct hpsjam_packet *ptr;
 	struct hpsjam_packet_entry *pres;
 	float temp[HPSJAM_MAX_PKT];
 	size_t num;
 
-	QMutexLocker locker(&lock);
-
-	if (valid == false) {
-		memset(tmp_audio, 0, sizeof(tmp_audio));
-		return;
-	}
-
-	while ((pkt = input_pkt.first_pkt(in_audio[0].total == 0))) {
-		for (ptr = pkt->start; ptr->valid(pkt->end); ptr = ptr->next()) {
-			/* check for unsequenced packets */
-			if (HpsJamReceiveUnSequenced
-			    <class hpsjam_server_peer>(*this, ptr, temp))
-				continue;
-			/* check if other side received packet */
-			if (ptr->getPeerSeqNo() == output_pkt.pend_seqno)
-				output_pkt.advance();
-			/* check if sequence number matches */
-			if (ptr->getLocalSeqNo() != output_pkt.peer_seqno)
-				continue;
-			/* advance expected sequence number */
-			output_pkt.peer_seqno++;
-			output_pkt.send_ack = true;
-
-			switch (ptr->type) {
-			uint16_t packets;
-			uint16_t time_ms;
-			uint32_t features;
-			uint64_t passwd;
-			uint8_t mix;
-			uint8_t index;
-			const char *data;
-			size_t len;
-
-			case HPSJAM_TYPE_CONFIGURE_REQUEST:
-				if (ptr->getConfigure(output_fmt))
-					break;
-				output_fmt = HPSJAM_TYPE_AUDIO_SILENCE;
+	switch (ptr->type) {
+	uint16_t packets;
+	uint16_t time_ms;
+	uint32_t features;
+	uint64_t passwd;
+	uint8_t mix;
+	uint8_t index;
+	const char *data;
+	size_t len;
+
+	case HPSJAM_TYPE_CONFIGURE_REQUEST:
+		if (ptr->getConfigure(output_fmt))
+			break;
+		output_fmt = HPSJAM_TYPE_AUDIO_SILENCE;
+		break;
+	case HPSJAM_TYPE_PING_REQUEST:
+		if (ptr->getPing(packets, time_ms, passwd, features) &&
+		    output_pkt.find(HPSJAM_TYPE_PING_REPLY) == 0) {
+			if (hpsjam_no_multi_port)
+				features &= ~HPSJAM_FEATURE_MULTI_PORT;
+
+			pres = new struct hpsjam_packet_entry;
+			pres->data->packet.setPing(0, time_ms, 0, features &
+			    (HPSJAM_FEATURE_MULTI_PORT | HPSJAM_FEATURE_TELEMETRY |
+			     HPSJAM_FEATURE_LEVEL_RMS));
+			pres->data->packet.type = HPSJAM_TYPE_PING_REPLY;
+			pres->insert_tail(&output_pkt.head);
+
+			if (features & HPSJAM_FEATURE_MULTI_PORT)
+				multi_port = true;
+			if (features & HPSJAM_FEATURE_TELEMETRY)
+				telemetry = true;
+			if (features & HPSJAM_FEATURE_LEVEL_RMS)
+				level_rms = true;
+			if (features & HPSJAM_FEATURE_CONCEALMENT) {
+				in_audio.setConcealment(true);
+			}
+		}
+		break;
+	case HPSJAM_TYPE_ICON_REQUEST:
+		if (ptr->getRawData(&data, len)) {
+			/* prepend username */
+			icon = QByteArray(data, len);
+
+			pres = new struct hpsjam_packet_entry;
+			pres->data->packet.setFaderData(0, serverID(), icon.constData(), icon.length());
+			pres->data->packet.type = HPSJAM_TYPE_FADER_ICON_REPLY;
+			pres->insert_tail(&output_pkt.head);
+			hpsjam_server_broadcast(*pres, this);
+
+			/* tell this client about other icons */
+			for (unsigned x = 0; x != hpsjam_num_server_peers; x++) {
+				if (hpsjam_server_peers + x == this)
+					continue;
+				class hpsjam_server_peer &peer = hpsjam_server_peers[x];
+				QMutexLocker locker(&peer.lock);
+				if (peer.valid == false)
+					continue;
+				QByteArray &t = peer.icon;
+				pres = new struct hpsjam_packet_entry;
+				pres->data->packet.setFaderData(0, x, t.constData(), t.length());
+				pres->data->packet.type = HPSJAM_TYPE_FADER_ICON_REPLY;
+				pres->insert_tail(&output_pkt.head);
+			}
+		}
+		break;
+	case HPSJAM_TYPE_NAME_REQUEST:
+		if (ptr->getRawData(&data, len)) {
+			/* prepend username */
+			QByteArray t(data, len);
+			name = QString::fromUtf8(t);
+
+			pres = new struct hpsjam_packet_entry;
+			pres->data->packet.setFaderData(0, serverID(), t.constData(), t.length());
+			pres->data->packet.type = HPSJAM_TYPE_FADER_NAME_REPLY;
+			pres->insert_tail(&output_pkt.head);
+			hpsjam_server_broadcast(*pres, this);
+
+			/* tell this client about other names */
+			for (unsigned x = 0; x != hpsjam_num_server_peers; x++) {
+				if (hpsjam_server_peers + x == this)
+					continue;
+				class hpsjam_server_peer &peer = hpsjam_server_peers[x];
+				QMutexLocker locker(&peer.lock);
+				if (peer.valid == false)
+					continue;
+				t = peer.name.toUtf8();
+				pres = new struct hpsjam_packet_entry;
+				pres->data->packet.setFaderData(0, x, t.constData(), t.length());
+				pres->data->packet.type = HPSJAM_TYPE_FADER_NAME_REPLY;
+				pres->insert_tail(&output_pkt.head);
+			}
+		}
+		break;
+	case HPSJAM_TYPE_LYRICS_REQUEST:
+		if (ptr->getRawData(&data, len)) {
+			QByteArray t(data, len);
+
+			/* echo back lyrics */
+			pres = new struct hpsjam_packet_entry;
+			pres->data->packet.setRawData(t.constData(), t.length());
+			pres->data->packet.type = HPSJAM_TYPE_LYRICS_REPLY;
+			pres->insert_tail(&output_pkt.head);
+			hpsjam_server_broadcast(*pres, this);
+		}
+		break;
+	case HPSJAM_TYPE_CHAT_REQUEST:
+		if (ptr->getRawData(&data, len)) {
+			/* prepend username */
+			QByteArray t(data, len);
+			QString str = QString::fromUtf8(t);
+			str.prepend(QString("[") + name + QString("]: "));
+			str.truncate(128 + 32 + 4);
+			t = str.toUtf8();
+
+			/* echo back text */
+			pres = new struct hpsjam_packet_entry;
+			pres->data->packet.setRawData(t.constData(), t.length());
+			pres->data->packet.type = HPSJAM_TYPE_CHAT_REPLY;
+			pres->insert_tail(&output_pkt.head);
+			hpsjam_server_broadcast(*pres, this);
+		}
+		break;
+	case HPSJAM_TYPE_FADER_GAIN_REQUEST:
+		if (allow_mixer_access == false)
+			break;
+		if (ptr->getFaderValue(mix, index, temp, num)) {
+			assert(num <= HPSJAM_MAX_PKT);
+			if (mix != 0 || num <= 0)
 				break;
-			case HPSJAM_TYPE_PING_REQUEST:
-				if (ptr->getPing(packets, time_ms, passwd, features) &&
-				    output_pkt.find(HPSJAM_TYPE_PING_REPLY) == 0) {
-					if (hpsjam_no_multi_port)
-						features &= ~HPSJAM_FEATURE_MULTI_PORT;
-
-					pres = new struct hpsjam_packet_entry;
-					pres->packet.setPing(0, time_ms, 0, features & HPSJAM_FEATURE_MULTI_PORT);
-					pres->packet.type = HPSJAM_TYPE_PING_REPLY;
-					pres->insert_tail(&output_pkt.head);
-
-					if (features & HPSJAM_FEATURE_MULTI_PORT)
-						multi_port = true;
-				}
+			if (index + num > hpsjam_num_server_peers)
 				break;
-			case HPSJAM_TYPE_ICON_REQUEST:
-				if (ptr->getRawData(&data, len)) {
-					/* prepend username */
-					icon = QByteArray(data, len);
 
+			/* echo gain */
+			pres = new struct hpsjam_packet_entry;
+			pres->data->packet.setFaderValue(mix, index, temp, num);
+			pres->data->packet.type = HPSJAM_TYPE_FADER_GAIN_REPLY;
+			hpsjam_server_broadcast(*pres, this);
+			delete pres;
+
+			/* local gain */
+			for (size_t x = 0; x != num; x++) {
+				if (hpsjam_server_processing) {
+					pres = 0;
+				} else {
 					pres = new struct hpsjam_packet_entry;
-					pres->packet.setFaderData(0, serverID(), icon.constData(), icon.length());
-					pres->packet.type = HPSJAM_TYPE_FADER_ICON_REPLY;
-					pres->insert_tail(&output_pkt.head);
-					hpsjam_server_broadcast(*pres, this);
-
-					/* tell this client about other icons */
-					for (unsigned x = 0; x != hpsjam_num_server_peers; x++) {
-						if (hpsjam_server_peers + x == this)
-							continue;
-						class hpsjam_server_peer &peer = hpsjam_server_peers[x];
-						QMutexLocker locker(&peer.lock);
-						if (peer.valid == false)
-							continue;
-						QByteArray &t = peer.icon;
-						pres = new struct hpsjam_packet_entry;
-						pres->packet.setFaderData(0, x, t.constData(), t.length());
-						pres->packet.type = HPSJAM_TYPE_FADER_ICON_REPLY;
-						pres->insert_tail(&output_pkt.head);
-					}
+					pres->data->packet.setFaderValue(0, 0, temp + x, 1);
+					pres->data->packet.type = HPSJAM_TYPE_LOCAL_GAIN_REPLY;
 				}
-				break;
-			case HPSJAM_TYPE_NAME_REQUEST:
-				if (ptr->getRawData(&data, len)) {
-					/* prepend username */
-					QByteArray t(data, len);
-					name = QString::fromUtf8(t);
 
-					pres = new struct hpsjam_packet_entry;
-					pres->packet.setFaderData(0, serverID(), t.constData(), t.length());
-					pres->packet.type = HPSJAM_TYPE_FADER_NAME_REPLY;
-					pres->insert_tail(&output_pkt.head);
-					hpsjam_server_broadcast(*pres, this);
-
-					/* tell this client about other names */
-					for (unsigned x = 0; x != hpsjam_num_server_peers; x++) {
-						if (hpsjam_server_peers + x == this)
-							continue;
-						class hpsjam_server_peer &peer = hpsjam_server_peers[x];
-						QMutexLocker locker(&peer.lock);
-						if (peer.valid == false)
-							continue;
-						t = peer.name.toUtf8();
-						pres = new struct hpsjam_packet_entry;
-						pres->packet.setFaderData(0, x, t.constData(), t.length());
-						pres->packet.type = HPSJAM_TYPE_FADER_NAME_REPLY;
+				if (index + x == serverID()) {
+					if (pres != 0)
 						pres->insert_tail(&output_pkt.head);
-					}
-				}
-				break;
-			case HPSJAM_TYPE_LYRICS_REQUEST:
-				pres = new struct hpsjam_packet_entry;
-				if (ptr->getRawData(&data, len)) {
-					QByteArray t(data, len);
-
-					/* echo back lyrics */
-					pres = new struct hpsjam_packet_entry;
-					pres->packet.setRawData(t.constData(), t.length());
-					pres->packet.type = HPSJAM_TYPE_LYRICS_REPLY;
-					pres->insert_tail(&output_pkt.head);
-					hpsjam_server_broadcast(*pres, this);
-				}
-				break;
-			case HPSJAM_TYPE_CHAT_REQUEST:
-				if (ptr->getRawData(&data, len)) {
-					/* prepend username */
-					QByteArray t(data, len);
-					QString str = QString::fromUtf8(t);
-					str.prepend(QString("[") + name + QString("]: "));
-					str.truncate(128 + 32 + 4);
-					t = str.toUtf8();
-
-					/* echo back text */
-					pres = new struct hpsjam_packet_entry;
-					pres->packet.setRawData(t.constData(), t.length());
-					pres->packet.type = HPSJAM_TYPE_CHAT_REPLY;
-					pres->insert_tail(&output_pkt.head);
-					hpsjam_server_broadcast(*pres, this);
-				}
-				break;
-			case HPSJAM_TYPE_FADER_GAIN_REQUEST:
-				if (allow_mixer_access == false)
-					break;
-				if (ptr->getFaderValue(mix, index, temp, num)) {
-					assert(num <= HPSJAM_MAX_PKT);
-					if (mix != 0 || num <= 0)
-						break;
-					if (index + num > hpsjam_num_server_peers)
-						break;
-
-					/* echo gain */
-					pres = new struct hpsjam_packet_entry;
-					pres->packet.setFaderValue(mix, index, temp, num);
-					pres->packet.type = HPSJAM_TYPE_FADER_GAIN_REPLY;
-					hpsjam_server_broadcast(*pres, this);
-					delete pres;
-
-					/* local gain */
-					for (size_t x = 0; x != num; x++) {
-						pres = new struct hpsjam_packet_entry;
-						pres->packet.setFaderValue(0, 0, temp + x, 1);
-						pres->packet.type = HPSJAM_TYPE_LOCAL_GAIN_REPLY;
-
-						if (index + x == serverID()) {
-							pres->insert_tail(&output_pkt.head);
-							gain = temp[x];
-						} else {
-							hpsjam_server_peer &peer = hpsjam_server_peers[index + x];
-							QMutexLocker peer_locker(&peer.lock);
-							pres->insert_tail(&peer.output_pkt.head);
-							peer.gain = temp[x];
-						}
-					}
+					gain = temp[x];
+				} else {
+					hpsjam_server_peer &peer = hpsjam_server_peers[index + x];
+					QMutexLocker peer_locker(&peer.lock);
+					if (pres != 0)
+						pres->insert_tail(&peer.output_pkt.head);
+					peer.gain = temp[x];
 				}
+			}
+		}
+		break;
+	case HPSJAM_TYPE_FADER_PAN_REQUEST:
+		if (allow_mixer_access == false)
+			break;
+		if (ptr->getFaderValue(mix, index, temp, num)) {
+			assert(num <= HPSJAM_MAX_PKT);
+			if (mix != 0 || num <= 0)
 				break;
-			case HPSJAM_TYPE_FADER_PAN_REQUEST:
-				if (allow_mixer_access == false)
-					break;
-				if (ptr->getFaderValue(mix, index, temp, num)) {
-					assert(num <= HPSJAM_MAX_PKT);
-					if (mix != 0 || num <= 0)
-						break;
-					if (index + num > hpsjam_num_server_peers)
-						break;
-
-					/* echo pan */
-					pres = new struct hpsjam_packet_entry;
-					pres->packet.setFaderValue(mix, index, temp, num);
-					pres->packet.type = HPSJAM_TYPE_FADER_PAN_REPLY;
-					hpsjam_server_broadcast(*pres, this);
-					delete pres;
-
-					/* local pan */
-					for (size_t x = 0; x != num; x++) {
-						pres = new struct hpsjam_packet_entry;
-						pres->packet.setFaderValue(0, 0, temp + x, 1);
-						pres->packet.type = HPSJAM_TYPE_LOCAL_PAN_REPLY;
-
-						if (index + x == serverID()) {
-							pres->insert_tail(&output_pkt.head);
-							pan = temp[x];
-						} else {
-							hpsjam_server_peer &peer = hpsjam_server_peers[index + x];
-							QMutexLocker peer_locker(&peer.lock);
-							pres->insert_tail(&peer.output_pkt.head);
-							peer.pan = temp[x];
-						}
-					}
-				}
+			if (index + num > hpsjam_num_server_peers)
 				break;
-			case HPSJAM_TYPE_FADER_EQ_REQUEST:
-				if (allow_mixer_access == false)
-					break;
-				if (ptr->getFaderData(mix, index, &data, num)) {
-					if (mix != 0)
-						break;
-					if (index >= hpsjam_num_server_peers)
-						break;
 
-					/* echo EQ */
+			/* echo pan */
+			pres = new struct hpsjam_packet_entry;
+			pres->data->packet.setFaderValue(mix, index, temp, num);
+			pres->data->packet.type = HPSJAM_TYPE_FADER_PAN_REPLY;
+			hpsjam_server_broadcast(*pres, this);
+			delete pres;
+
+			/* local pan */
+			for (size_t x = 0; x != num; x++) {
+				if (hpsjam_server_processing) {
+					pres = 0;
+				} else {
 					pres = new struct hpsjam_packet_entry;
-					pres->packet.setFaderData(mix, index, data, num);
-					pres->packet.type = HPSJAM_TYPE_FADER_EQ_REPLY;
-					hpsjam_server_broadcast(*pres, this);
-
-					pres->packet.setFaderData(0, 0, data, num);
-					pres->packet.type = HPSJAM_TYPE_LOCAL_EQ_REPLY;
+					pres->data->packet.setFaderValue(0, 0, temp + x, 1);
+					pres->data->packet.type = HPSJAM_TYPE_LOCAL_PAN_REPLY;
+				}
 
-					/* local EQ */
-					if (index == serverID()) {
+				if (index + x == serverID()) {
+					if (pres != 0)
 						pres->insert_tail(&output_pkt.head);
-						delete [] eq_data;
-						eq_data = new char [eq_size = num];
-						memcpy(eq_data, data, eq_size);
-					} else {
-						hpsjam_server_peer &peer = hpsjam_server_peers[index];
-						QMutexLocker other(&peer.lock);
+					pan = temp[x];
+				} else {
+					hpsjam_server_peer &peer = hpsjam_server_peers[index + x];
+					QMutexLocker peer_locker(&peer.lock);
+					if (pres != 0)
 						pres->insert_tail(&peer.output_pkt.head);
-						delete [] peer.eq_data;
-						peer.eq_data = new char [peer.eq_size = num];
-						memcpy(peer.eq_data, data, peer.eq_size);
-					}
+					peer.pan = temp[x];
 				}
+			}
+		}
+		break;
+	case HPSJAM_TYPE_FADER_EQ_REQUEST:
+		if (allow_mixer_access == false)
+			break;
+		if (ptr->getFaderData(mix, index, &data, num)) {
+			if (mix != 0)
 				break;
-			case HPSJAM_TYPE_FADER_BITS_REQUEST:
-				if (ptr->getFaderData(mix, index, &data, num)) {
-					if (mix != 0 || num <= 0)
-						break;
-					if (index + num > hpsjam_num_server_peers)
-						break;
-					/* copy bits in place */
-					memcpy(bits + index, data, num);
-				}
+			if (index >= hpsjam_num_server_peers)
 				break;
-			case HPSJAM_TYPE_SET_PORT_ORDER_REQUEST:
-				if (ptr->getPortOrder(output_pkt.port_mapping, HPSJAM_PORTS_MAX)) {
-					pres = new struct hpsjam_packet_entry;
-					pres->packet.length = 1;
-					pres->packet.sequence[0] = 0;
-					pres->packet.sequence[1] = 0;
-					pres->packet.type = HPSJAM_TYPE_SET_PORT_ORDER_REPLY;
+
+			/* echo EQ */
+			pres = new struct hpsjam_packet_entry;
+			pres->data->packet.setFaderData(mix, index, data, num);
+			pres->data->packet.type = HPSJAM_TYPE_FADER_EQ_REPLY;
+			hpsjam_server_broadcast(*pres, this);
+			delete pres;
+
+			if (hpsjam_server_processing) {
+				pres = 0;
+			} else {
+				pres = new struct hpsjam_packet_entry;
+				pres->data->packet.setFaderData(0, 0, data, num);
+				pres->data->packet.type = HPSJAM_TYPE_LOCAL_EQ_REPLY;
+			}
+
+			/* local EQ */
+			if (index == serverID()) {
+				if (pres != 0)
 					pres->insert_tail(&output_pkt.head);
-				}
+				delete [] eq_data;
+				eq_data = new char [eq_size = num];
+				memcpy(eq_data, data, eq_size);
+				if (pres == 0 && eq != 0)
+					eq->init(data, num);
+			} else {
+				hpsjam_server_peer &peer = hpsjam_server_peers[index];
+				QMutexLocker other(&peer.lock);
+				if (pres != 0)
+					pres->insert_tail(&peer.output_pkt.head);
+				delete [] peer.eq_data;
+				peer.eq_data = new char [peer.eq_size = num];
+				memcpy(peer.eq_data, data, peer.eq_size);
+				if (pres == 0 && peer.eq != 0)
+					peer.eq->init(data, num);
+			}
+		}
+		break;
+	case HPSJAM_TYPE_FADER_BITS_REQUEST:
+		if (ptr->getFaderData(mix, index, &data, num)) {
+			if (mix != 0 || num <= 0)
 				break;
-			case HPSJAM_TYPE_SET_PORT_ORDER_REPLY:
-				input_pkt.reset_time_variance();
+			if (index + num > hpsjam_num_server_peers)
 				break;
+			/* copy bits in place */
+			memcpy(bits + index, data, num);
+		}
+		break;
+	case HPSJAM_TYPE_SET_PORT_ORDER_REQUEST:
+		if (ptr->getPortOrder(output_pkt.port_mapping, HPSJAM_PORTS_MAX)) {
+			pres = new struct hpsjam_packet_entry;
+			pres->data->packet.length = 1;
+			pres->data->packet.sequence[0] = 0;
+			pres->data->packet.sequence[1] = 0;
+			pres->data->packet.type = HPSJAM_TYPE_SET_PORT_ORDER_REPLY;
+			pres->insert_tail(&output_pkt.head);
+		}
+		break;
+	case HPSJAM_TYPE_SET_PORT_ORDER_REPLY:
+		input_pkt->reset_time_variance();
+		break;
 
-			default:
-				break;
+	default:
+		break;
+	}
+}
+
+void
+hpsjam_server_peer :: audio_export()
+{
+	const union hpsjam_frame *pkt;
+	const struct hpsjam_packet *ptr;
+	struct hpsjam_packet_data *pdata;
+	struct hpsjam_packet_entry *pres;
+	float temp[HPSJAM_MAX_PKT];
+
+	QMutexLocker locker(&lock);
+
+	if (valid == false) {
+		memset(tmp_audio, 0, sizeof(tmp_audio));
+		tmp_mono = true;
+		return;
+	}
+
+	while ((pkt = input_pkt->first_pkt(in_audio.total == 0))) {
+		for (ptr = pkt->start; ptr->valid(pkt->end); ptr = ptr->next()) {
+			/* check for unsequenced packets */
+			if (HpsJamReceiveUnSequenced
+			    <class hpsjam_server_peer>(*this, ptr, temp))
+				continue;
+			/* check if other side received packets */
+			output_pkt.ack(ptr->getPeerSeqNo());
+			/* check if sequence number matches */
+			if (output_pkt.rx_sequenced(*ptr) == false)
+				continue;
+			receive_sequenced(ptr);
+
+			/* process buffered packets which are now in order */
+			while ((pdata = output_pkt.rx_next())) {
+				receive_sequenced(&pdata->packet);
+				pdata->unref();
 			}
 		}
 	}
@@ -1048,17 +1165,52 @@ hpsjam_server_peer :: audio_export()
 	/* send a ping, if idle */
 	if (output_pkt.empty()) {
 		pres = new struct hpsjam_packet_entry;
-		pres->packet.setPing(0, hpsjam_ticks, 0, 0);
-		pres->packet.type = HPSJAM_TYPE_PING_REQUEST;
+		pres->data->packet.setPing(0, hpsjam_ticks, 0, 0);
+		pres->data->packet.type = HPSJAM_TYPE_PING_REQUEST;
 		pres->insert_tail(&output_pkt.head);
 	}
 
 	/* extract samples for this tick */
-	in_audio[0].remSamples(tmp_audio[0], HPSJAM_DEF_SAMPLES);
-	in_audio[1].remSamples(tmp_audio[1], HPSJAM_DEF_SAMPLES);
+	tmp_mono = (in_audio.channels == 1);
+	in_audio.remSamples(tmp_audio[0], tmp_mono ? 0 : tmp_audio[1], HPSJAM_DEF_SAMPLES);
+
+	/* check if we should apply the mixer settings */
+	if (hpsjam_server_processing)
+		audio_process();
 
 	/* check if we should adjust the timer */
-	hpsjam_server_adjust[in_audio[0].getLowWater()]++;
+	hpsjam_server_adjust[in_audio.getLowWater()]++;
+}
+
+/* apply EQ, pan and gain, instead of the client */
+void
+hpsjam_server_peer :: audio_process()
+{
+	const bool equalize = (eq != 0 && eq->isActive());
+	const bool stereo = (equalize || pan != 0.0f);
+
+	if (stereo && tmp_mono) {
+		memcpy(tmp_audio[1], tmp_audio[0], sizeof(tmp_audio[1]));
+		tmp_mono = false;
+	}
+
+	/* Process equalizer */
+	if (equalize)
+		eq->doit(tmp_audio[0], tmp_audio[1], HPSJAM_DEF_SAMPLES);
+
+	/* Process panning */
+	if (pan != 0.0f)
+		hpsjam_process_pan(tmp_audio[0], tmp_audio[1], pan, HPSJAM_DEF_SAMPLES);
+
+	/* Process gain */
+	if (gain < 1.0f) {
+		for (size_t x = 0; x != HPSJAM_DEF_SAMPLES; x++)
+			tmp_audio[0][x] *= gain;
+		if (tmp_mono == false) {
+			for (size_t x = 0; x != HPSJAM_DEF_SAMPLES; x++)
+				tmp_audio[1][x] *= gain;
+		}
+	}
 }
 
 void
@@ -1070,8 +1222,8 @@ hpsjam_server_peer :: audio_import()
 		return;
 
 	/* process output audio */
-	HpsJamProcessOutputAudio
-	    <class hpsjam_server_peer>(*this, out_audio[0], out_audio[1]);
+	HpsJamProcessOutputAudio<class hpsjam_server_peer>(*this, out_audio[0],
+	    hpsjam_audio_format_is_mono(output_fmt) ? 0 : out_audio[1]);
 
 	/* send a packet */
 	HpsJamSendPacket
@@ -1098,8 +1250,8 @@ hpsjam_server_peer :: send_welcome_message()
 		QByteArray t = line.toUtf8();
 
 		struct hpsjam_packet_entry *pres = new struct hpsjam_packet_entry;
-		pres->packet.setRawData(t.constData(), t.length());
-		pres->packet.type = HPSJAM_TYPE_CHAT_REPLY;
+		pres->data->packet.setRawData(t.constData(), t.length());
+		pres->data->packet.type = HPSJAM_TYPE_CHAT_REPLY;
 		pres->insert_tail(&output_pkt.head);
 	}
 }
@@ -1110,7 +1262,10 @@ hpsjam_send_levels()
 	constexpr size_t maxLevel = 32;
 	static unsigned group;
 	struct hpsjam_packet_entry entry;
+	struct hpsjam_packet_data *pdata;
+	struct hpsjam_packet_data *prms;
 	float level_temp[maxLevel][2];
+	float rms_temp[maxLevel][4];
 
 	if (hpsjam_ticks % 128)
 		return;
@@ -1119,8 +1274,8 @@ hpsjam_send_levels()
 		unsigned index = x + group * maxLevel;
 
 		if (index >= hpsjam_num_server_peers) {
-			level_temp[x][0] = 0.0f;
-			level_temp[x][1] = 0.0f;
+			memset(level_temp[x], 0, sizeof(level_temp[x]));
+			memset(rms_temp[x], 0, sizeof(rms_temp[x]));
 			continue;
 		}
 
@@ -1128,14 +1283,43 @@ hpsjam_send_levels()
 		if (hpsjam_server_peers[index].valid) {
 			level_temp[x][0] = hpsjam_server_peers[index].in_level[0].getLevel();
 			level_temp[x][1] = hpsjam_server_peers[index].in_level[1].getLevel();
+			rms_temp[x][0] = level_temp[x][0];
+			rms_temp[x][1] = level_temp[x][1];
+			rms_temp[x][2] = hpsjam_server_peers[index].in_level[0].getRMS();
+			rms_temp[x][3] = hpsjam_server_peers[index].in_level[1].getRMS();
 		} else {
-			level_temp[x][0] = 0.0f;
-			level_temp[x][1] = 0.0f;
+			memset(level_temp[x], 0, sizeof(level_temp[x]));
+			memset(rms_temp[x], 0, sizeof(rms_temp[x]));
 		}
 	}
-	entry.packet.setFaderValue(0, group * maxLevel, level_temp[0], 2 * maxLevel);
-	entry.packet.type = HPSJAM_TYPE_FADER_LEVEL_REPLY;
-	hpsjam_server_broadcast(entry, 0, true);
+	entry.data->packet.setFaderValue(0, group * maxLevel, level_temp[0], 2 * maxLevel);
+	entry.data->packet.type = HPSJAM_TYPE_FADER_LEVEL_REPLY;
+
+	/* best-effort copy for peers supporting telemetry */
+	pdata = new struct hpsjam_packet_data;
+	memcpy(pdata->raw, entry.data->raw, entry.data->packet.getBytes());
+	pdata->packet.type = HPSJAM_TYPE_FADER_LEVEL_TELEMETRY;
+
+	/* peak and RMS levels for peers supporting it */
+	prms = new struct hpsjam_packet_data;
+	prms->packet.setFaderValue(0, group * maxLevel, rms_temp[0], 4 * maxLevel);
+	prms->packet.type = HPSJAM_TYPE_FADER_RMS_TELEMETRY;
+
+	for (unsigned x = 0; x != hpsjam_num_server_peers; x++) {
+		class hpsjam_server_peer &peer = hpsjam_server_peers[x];
+		QMutexLocker locker(&peer.lock);
+
+		if (peer.valid == false)
+			continue;
+		if (peer.telemetry && peer.level_rms)
+			peer.output_pkt.set_telemetry(prms);
+		else if (peer.telemetry)
+			peer.output_pkt.set_telemetry(pdata);
+		else if (peer.output_pkt.find(HPSJAM_TYPE_FADER_LEVEL_REPLY) == 0)
+			(new struct hpsjam_packet_entry(entry.data))->insert_tail(&peer.output_pkt.head);
+	}
+	pdata->unref();
+	prms->unref();
 
 	/* advance to next group */
 	group++;
@@ -1180,13 +1364,13 @@ hpsjam_server_peer :: send_mixer_parameters()
 		}
 
 		pres = new struct hpsjam_packet_entry;
-		pres->packet.setFaderValue(0, group * maxLevel, gain_temp, maxLevel);
-		pres->packet.type = HPSJAM_TYPE_FADER_GAIN_REPLY;
+		pres->data->packet.setFaderValue(0, group * maxLevel, gain_temp, maxLevel);
+		pres->data->packet.type = HPSJAM_TYPE_FADER_GAIN_REPLY;
 		pres->insert_tail(&output_pkt.head);
 
 		pres = new struct hpsjam_packet_entry;
-		pres->packet.setFaderValue(0, group * maxLevel, pan_temp, maxLevel);
-		pres->packet.type = HPSJAM_TYPE_FADER_PAN_REPLY;
+		pres->data->packet.setFaderValue(0, group * maxLevel, pan_temp, maxLevel);
+		pres->data->packet.type = HPSJAM_TYPE_FADER_PAN_REPLY;
 		pres->insert_tail(&output_pkt.head);
 	}
 
@@ -1200,8 +1384,8 @@ hpsjam_server_peer :: send_mixer_parameters()
 		if (peer.valid == false || peer.eq_size == 0)
 			continue;
 		pres = new struct hpsjam_packet_entry;
-		pres->packet.setFaderData(0, index, peer.eq_data, peer.eq_size);
-		pres->packet.type = HPSJAM_TYPE_FADER_EQ_REPLY;
+		pres->data->packet.setFaderData(0, index, peer.eq_data, peer.eq_size);
+		pres->data->packet.type = HPSJAM_TYPE_FADER_EQ_REPLY;
 		pres->insert_tail(&output_pkt.head);
 	}
 }
@@ -1227,6 +1411,32 @@ get_gain_from_bits(uint8_t value)
 static struct hpsjam_server_default_mix hpsjam_server_default_mix[HPSJAM_CPU_MAX];
 hpsjam_midi_buffer *hpsjam_default_midi;
 
+/* add the audio of "other" scaled by "gain" to the given mix */
+static inline void
+hpsjam_server_mix(float (*mix)[64], bool mono,
+    const class hpsjam_server_peer &other, float gain)
+{
+	if (mono && other.tmp_mono) {
+		for (unsigned z = 0; z != HPSJAM_DEF_SAMPLES; z++)
+			mix[0][z] += other.tmp_audio[0][z] * gain;
+	} else if (mono) {
+		gain /= 2.0f;
+		for (unsigned z = 0; z != HPSJAM_DEF_SAMPLES; z++)
+			mix[0][z] += (other.tmp_audio[0][z] + other.tmp_audio[1][z]) * gain;
+	} else if (other.tmp_mono) {
+		for (unsigned z = 0; z != HPSJAM_DEF_SAMPLES; z++) {
+			const float value = other.tmp_audio[0][z] * gain;
+			mix[0][z] += value;
+			mix[1][z] += value;
+		}
+	} else {
+		for (unsigned z = 0; z != HPSJAM_DEF_SAMPLES; z++) {
+			mix[0][z] += other.tmp_audio[0][z] * gain;
+			mix[1][z] += other.tmp_audio[1][z] * gain;
+		}
+	}
+}
+
 void
 hpsjam_server_peer :: audio_mixing()
 {
@@ -1238,6 +1448,9 @@ hpsjam_server_peer :: audio_mixing()
 		return;
 	}
 
+	/* mono outputs are mixed in the left channel only */
+	const bool mono = hpsjam_audio_format_is_mono(output_fmt);
+
 	for (unsigned y = 0; y != hpsjam_num_server_peers; y++) {
 		if (bits[y] & HPSJAM_BIT_SOLO)
 			goto do_solo;
@@ -1245,7 +1458,14 @@ hpsjam_server_peer :: audio_mixing()
 
 	/* use the default mix as a starting point */
 	assert(sizeof(out_audio) == sizeof(hpsjam_server_default_mix[0].out_audio));
-	memcpy(out_audio, hpsjam_server_default_mix[0].out_audio, sizeof(out_audio));
+	if (mono) {
+		for (unsigned z = 0; z != HPSJAM_DEF_SAMPLES; z++) {
+			out_audio[0][z] = (hpsjam_server_default_mix[0].out_audio[0][z] +
+			    hpsjam_server_default_mix[0].out_audio[1][z]) / 2.0f;
+		}
+	} else {
+		memcpy(out_audio, hpsjam_server_default_mix[0].out_audio, sizeof(out_audio));
+	}
 
 	for (unsigned y = 0; y != hpsjam_num_server_peers; y++) {
 		const class hpsjam_server_peer &other = hpsjam_server_peers[y];
@@ -1253,27 +1473,18 @@ hpsjam_server_peer :: audio_mixing()
 		if (other.valid == false || bits[y] == 0)
 			continue;
 		if (bits[y] & HPSJAM_BIT_MUTE) {
-			for (unsigned z = 0; z != HPSJAM_DEF_SAMPLES; z++) {
-				/* silence own mix */
-				out_audio[0][z] -= other.tmp_audio[0][z];
-				out_audio[1][z] -= other.tmp_audio[1][z];
-			}
+			/* silence own mix */
+			hpsjam_server_mix(out_audio, mono, other, -1.0f);
 		} else if (bits[y] & HPSJAM_BIT_INVERT) {
 			const int32_t gain = get_gain_from_bits(bits[y]) + 256;
 
-			for (unsigned z = 0; z != HPSJAM_DEF_SAMPLES; z++) {
-				/* adjust mix */
-				out_audio[0][z] -= float_gain(other.tmp_audio[0][z], gain);
-				out_audio[1][z] -= float_gain(other.tmp_audio[1][z], gain);
-			}
+			/* adjust mix */
+			hpsjam_server_mix(out_audio, mono, other, float_gain(-1.0f, gain));
 		} else {
 			const int32_t gain = get_gain_from_bits(bits[y]) - 256;
 
-			for (unsigned z = 0; z != HPSJAM_DEF_SAMPLES; z++) {
-				/* adjust mix */
-				out_audio[0][z] += float_gain(other.tmp_audio[0][z], gain);
-				out_audio[1][z] += float_gain(other.tmp_audio[1][z], gain);
-			}
+			/* adjust mix */
+			hpsjam_server_mix(out_audio, mono, other, float_gain(1.0f, gain));
 		}
 	}
 	return;
@@ -1292,17 +1503,11 @@ do_solo:
 		if (bits[y] & HPSJAM_BIT_INVERT) {
 			const int32_t gain = get_gain_from_bits(bits[y]);
 
-			for (unsigned z = 0; z != HPSJAM_DEF_SAMPLES; z++) {
-				out_audio[0][z] -= float_gain(other.tmp_audio[0][z], gain);
-				out_audio[1][z] -= float_gain(other.tmp_audio[1][z], gain);
-			}
+			hpsjam_server_mix(out_audio, mono, other, float_gain(-1.0f, gain));
 		} else {
 			const int32_t gain = get_gain_from_bits(bits[y]);
 
-			for (unsigned z = 0; z != HPSJAM_DEF_SAMPLES; z++) {
-				out_audio[0][z] += float_gain(other.tmp_audio[0][z], gain);
-				out_audio[1][z] += float_gain(other.tmp_audio[1][z], gain);
-			}
+			hpsjam_server_mix(out_audio, mono, other, float_gain(1.0f, gain));
 		}
 	}
 }
@@ -1320,11 +1525,19 @@ hpsjam_server_get_audio(unsigned rem)
 		peer.audio_export();
 
 		/* create the default audio mix */
-		for (unsigned z = 0; z != HPSJAM_DEF_SAMPLES; z++) {
-			hpsjam_server_default_mix[rem].out_audio[0][z] +=
-			    peer.tmp_audio[0][z];
-			hpsjam_server_default_mix[rem].out_audio[1][z] +=
-			    peer.tmp_audio[1][z];
+		if (peer.tmp_mono) {
+			for (unsigned z = 0; z != HPSJAM_DEF_SAMPLES; z++) {
+				const float value = peer.tmp_audio[0][z];
+				hpsjam_server_default_mix[rem].out_audio[0][z] += value;
+				hpsjam_server_default_mix[rem].out_audio[1][z] += value;
+			}
+		} else {
+			for (unsigned z = 0; z != HPSJAM_DEF_SAMPLES; z++) {
+				hpsjam_server_default_mix[rem].out_audio[0][z] +=
+				    peer.tmp_audio[0][z];
+				hpsjam_server_default_mix[rem].out_audio[1][z] +=
+				    peer.tmp_audio[1][z];
+			}
 		}
 
 		/* create the default MIDI mix */
@@ -1422,20 +1635,24 @@ hpsjam_server_tick()
 		hpsjam_timer_adjust = -1;	/* go faster */
 	}
 
-	/* Adjust all buffers every 16 seconds approximately. */
+	/* Adjust all buffers every 4 seconds approximately. */
 	unsigned y = (hpsjam_ticks & HPSJAM_ADJUST_TICKS);
 	if (y < hpsjam_num_server_peers) {
 		hpsjam_server_peer &peer = hpsjam_server_peers[y];
 
 		QMutexLocker locker(&peer.lock);
 		if (peer.valid) {
-			peer.out_buffer[0].adjustBuffer();
-			peer.out_buffer[1].adjustBuffer();
-			peer.in_audio[0].adjustBuffer();
-			peer.in_audio[1].adjustBuffer();
-
-			HpsJamSendPortOrderRequest
+			HpsJamAdaptWaterTarget
 			    <class hpsjam_server_peer>(peer);
+
+			peer.out_buffer.adjustBuffer();
+			peer.in_audio.adjustBuffer();
+
+			/* Check the port order every 16 seconds approximately. */
+			if ((hpsjam_ticks & HPSJAM_PORT_ORDER_TICKS) == y) {
+				HpsJamSendPortOrderRequest
+				    <class hpsjam_server_peer>(peer);
+			}
 		}
 	}
 
@@ -1458,12 +1675,199 @@ hpsjam_client_peer :: handle_pending_watchdog()
 
 	if (address[0].valid() && output_pkt.empty()) {
 		struct hpsjam_packet_entry *pkt = new struct hpsjam_packet_entry;
-		pkt->packet.setPing(0, hpsjam_ticks, 0, 0);
-		pkt->packet.type = HPSJAM_TYPE_PING_REQUEST;
+		pkt->data->packet.setPing(0, hpsjam_ticks, 0, 0);
+		pkt->data->packet.type = HPSJAM_TYPE_PING_REQUEST;
 		pkt->insert_tail(&output_pkt.head);
 	}
 }
 
+void
+hpsjam_client_peer :: receive_levels(const struct hpsjam_packet *ptr)
+{
+	float temp[HPSJAM_MAX_PKT];
+	uint8_t mix;
+	uint8_t index;
+	size_t num;
+
+	if (ptr->getFaderValue(mix, index, temp, num)) {
+		assert(num <= HPSJAM_MAX_PKT);
+		if (mix != 0 || (num % 2) != 0 || num <= 0)
+			return;
+		if (index + (num / 2) > HPSJAM_PEERS_MAX)
+			return;
+		for (size_t x = 0; x != (num / 2); x++)
+			emit receivedFaderLevel(mix, index + x, temp[2 * x], temp[2 * x + 1]);
+	}
+}
+
+void
+hpsjam_client_peer :: receive_rms_levels(const struct hpsjam_packet *ptr)
+{
+	float temp[HPSJAM_MAX_PKT];
+	uint8_t mix;
+	uint8_t index;
+	size_t num;
+
+	if (ptr->getFaderValue(mix, index, temp, num)) {
+		assert(num <= HPSJAM_MAX_PKT);
+		if (mix != 0 || (num % 4) != 0 || num <= 0)
+			return;
+		if (index + (num / 4) > HPSJAM_PEERS_MAX)
+			return;
+		for (size_t x = 0; x != (num / 4); x++) {
+			emit receivedFaderLevel(mix, index + x, temp[4 * x], temp[4 * x + 1]);
+			emit receivedFaderRMS(mix, index + x, temp[4 * x + 2], temp[4 * x + 3]);
+		}
+	}
+}
+
+void
+hpsjam_client_peer :: receive_sequenced(const struct hpsjam_packet *ptr)
+{
+	struct hpsjam_packet_entry *pres;
+	float temp[HPSJAM_MAX_PKT];
+	size_t num;
+
+	switch (ptr->type) {
+	uint16_t packets;
+	uint16_t time_ms;
+	uint32_t features;
+	uint64_t passwd;
+	const char *data;
+	uint8_t mix;
+	uint8_t index;
+
+	case HPSJAM_TYPE_PING_REQUEST:
+		if (ptr->getPing(packets, time_ms, passwd, features) &&
+		    output_pkt.find(HPSJAM_TYPE_PING_REPLY) == 0) {
+			pres = new struct hpsjam_packet_entry;
+			pres->data->packet.setPing(0, time_ms, 0, features & HPSJAM_FEATURE_MULTI_PORT);
+			pres->data->packet.type = HPSJAM_TYPE_PING_REPLY;
+			pres->insert_tail(&output_pkt.head);
+		}
+		break;
+	case HPSJAM_TYPE_PING_REPLY:
+		if (ptr->getPing(packets, time_ms, passwd, features)) {
+			if (features & HPSJAM_FEATURE_MULTI_PORT)
+				multi_port = true;
+		}
+		break;
+	case HPSJAM_TYPE_LYRICS_REPLY:
+		if (ptr->getRawData(&data, num)) {
+			QByteArray t(data, num);
+			emit receivedLyrics(new QString(QString::fromUtf8(t)));
+		}
+		break;
+	case HPSJAM_TYPE_CHAT_REPLY:
+		if (ptr->getRawData(&data, num)) {
+			QByteArray t(data, num);
+			emit receivedChat(new QString(QString::fromUtf8(t)));
+		}
+		break;
+	case HPSJAM_TYPE_FADER_ICON_REPLY:
+		if (ptr->getFaderData(mix, index, &data, num)) {
+			if (mix != 0)
+				break;
+			if (self_index == -1) {
+				self_index = index;
+				emit receivedFaderSelf(mix, index);
+			}
+			emit receivedFaderIcon(mix, index, new QByteArray(data, num));
+		}
+		break;
+	case HPSJAM_TYPE_FADER_NAME_REPLY:
+		if (ptr->getFaderData(mix, index, &data, num)) {
+			if (mix != 0)
+				break;
+			if (self_index == -1) {
+				self_index = index;
+				emit receivedFaderSelf(mix, index);
+			}
+			QByteArray t(data, num);
+			emit receivedFaderName(mix, index, new QString(QString::fromUtf8(t)));
+		}
+		break;
+	case HPSJAM_TYPE_FADER_GAIN_REPLY:
+		if (ptr->getFaderValue(mix, index, temp, num)) {
+			assert(num <= HPSJAM_MAX_PKT);
+			if (mix != 0 || num <= 0)
+				break;
+			if (index + num > HPSJAM_PEERS_MAX)
+				break;
+			for (size_t x = 0; x != num; x++)
+				emit receivedFaderGain(mix, index + x, temp[x]);
+		}
+		break;
+	case HPSJAM_TYPE_FADER_PAN_REPLY:
+		if (ptr->getFaderValue(mix, index, temp, num)) {
+			assert(num <= HPSJAM_MAX_PKT);
+			if (mix != 0 || num <= 0)
+				break;
+			if (index + num > HPSJAM_PEERS_MAX)
+				break;
+			for (size_t x = 0; x != num; x++)
+				emit receivedFaderPan(mix, index + x, temp[x]);
+		}
+		break;
+	case HPSJAM_TYPE_FADER_LEVEL_REPLY:
+		receive_levels(ptr);
+		break;
+	case HPSJAM_TYPE_LOCAL_GAIN_REPLY:
+		if (ptr->getFaderValue(mix, index, temp, num)) {
+			assert(num <= HPSJAM_MAX_PKT);
+			if (mix != 0 || index != 0 || num != 1)
+				break;
+			in_gain = temp[0];
+		}
+		break;
+	case HPSJAM_TYPE_LOCAL_PAN_REPLY:
+		if (ptr->getFaderValue(mix, index, temp, num)) {
+			assert(num <= HPSJAM_MAX_PKT);
+			if (mix != 0 || index != 0 || num != 1)
+				break;
+			in_pan = temp[0];
+		}
+		break;
+	case HPSJAM_TYPE_FADER_EQ_REPLY:
+		if (ptr->getFaderData(mix, index, &data, num)) {
+			if (mix != 0)
+				break;
+			QByteArray t(data, num);
+			emit receivedFaderEQ(mix, index, new QString(QString::fromLatin1(t)));
+		}
+		break;
+	case HPSJAM_TYPE_LOCAL_EQ_REPLY:
+		if (ptr->getFaderData(mix, index, &data, num)) {
+			if (mix != 0 || index != 0)
+				break;
+			eq->init(data, num);
+		}
+		break;
+	case HPSJAM_TYPE_FADER_DISCONNECT_REPLY:
+		if (ptr->getFaderData(mix, index, &data, num)) {
+			if (mix != 0)
+				break;
+			emit receivedFaderDisconnect(mix, index);
+		}
+		break;
+	case HPSJAM_TYPE_SET_PORT_ORDER_REQUEST:
+		if (ptr->getPortOrder(output_pkt.port_mapping, HPSJAM_PORTS_MAX)) {
+			pres = new struct hpsjam_packet_entry;
+			pres->data->packet.length = 1;
+			pres->data->packet.sequence[0] = 0;
+			pres->data->packet.sequence[1] = 0;
+			pres->data->packet.type = HPSJAM_TYPE_SET_PORT_ORDER_REPLY;
+			pres->insert_tail(&output_pkt.head);
+		}
+		break;
+	case HPSJAM_TYPE_SET_PORT_ORDER_REPLY:
+		input_pkt->reset_time_variance();
+		break;
+	default:
+		break;
+	}
+}
+
 void
 hpsjam_client_peer :: tick()
 {
@@ -1474,178 +1878,30 @@ hpsjam_client_peer :: tick()
 
 	const union hpsjam_frame *pkt;
 	const struct hpsjam_packet *ptr;
+	struct hpsjam_packet_data *pdata;
 	struct hpsjam_packet_entry *pres;
 	union {
 		float temp[HPSJAM_MAX_PKT];
 		float audio[2][HPSJAM_DEF_SAMPLES];
 	};
-	size_t num;
 
-	while ((pkt = input_pkt.first_pkt(in_audio[0].total == 0))) {
+	while ((pkt = input_pkt->first_pkt(in_audio.total == 0))) {
 		for (ptr = pkt->start; ptr->valid(pkt->end); ptr = ptr->next()) {
 			/* check for unsequenced packets */
 			if (HpsJamReceiveUnSequenced
 			    <class hpsjam_client_peer>(*this, ptr, temp))
 				continue;
-			/* check if other side received packet */
-			if (ptr->getPeerSeqNo() == output_pkt.pend_seqno)
-				output_pkt.advance();
+			/* check if other side received packets */
+			output_pkt.ack(ptr->getPeerSeqNo());
 			/* check if sequence number matches */
-			if (ptr->getLocalSeqNo() != output_pkt.peer_seqno)
+			if (output_pkt.rx_sequenced(*ptr) == false)
 				continue;
-			/* advance expected sequence number */
-			output_pkt.peer_seqno++;
-			output_pkt.send_ack = true;
-
-			switch (ptr->type) {
-			uint16_t packets;
-			uint16_t time_ms;
-			uint32_t features;
-			uint64_t passwd;
-			const char *data;
-			uint8_t mix;
-			uint8_t index;
-
-			case HPSJAM_TYPE_PING_REQUEST:
-				if (ptr->getPing(packets, time_ms, passwd, features) &&
-				    output_pkt.find(HPSJAM_TYPE_PING_REPLY) == 0) {
-					pres = new struct hpsjam_packet_entry;
-					pres->packet.setPing(0, time_ms, 0, features & HPSJAM_FEATURE_MULTI_PORT);
-					pres->packet.type = HPSJAM_TYPE_PING_REPLY;
-					pres->insert_tail(&output_pkt.head);
-				}
-				break;
-			case HPSJAM_TYPE_PING_REPLY:
-				if (ptr->getPing(packets, time_ms, passwd, features)) {
-					if (features & HPSJAM_FEATURE_MULTI_PORT)
-						multi_port = true;
-				}
-				break;
-			case HPSJAM_TYPE_LYRICS_REPLY:
-				if (ptr->getRawData(&data, num)) {
-					QByteArray t(data, num);
-					emit receivedLyrics(new QString(QString::fromUtf8(t)));
-				}
-				break;
-			case HPSJAM_TYPE_CHAT_REPLY:
-				if (ptr->getRawData(&data, num)) {
-					QByteArray t(data, num);
-					emit receivedChat(new QString(QString::fromUtf8(t)));
-				}
-				break;
-			case HPSJAM_TYPE_FADER_ICON_REPLY:
-				if (ptr->getFaderData(mix, index, &data, num)) {
-					if (mix != 0)
-						break;
-					if (self_index == -1) {
-						self_index = index;
-						emit receivedFaderSelf(mix, index);
-					}
-					emit receivedFaderIcon(mix, index, new QByteArray(data, num));
-				}
-				break;
-			case HPSJAM_TYPE_FADER_NAME_REPLY:
-				if (ptr->getFaderData(mix, index, &data, num)) {
-					if (mix != 0)
-						break;
-					if (self_index == -1) {
-						self_index = index;
-						emit receivedFaderSelf(mix, index);
-					}
-					QByteArray t(data, num);
-					emit receivedFaderName(mix, index, new QString(QString::fromUtf8(t)));
-				}
-				break;
-			case HPSJAM_TYPE_FADER_GAIN_REPLY:
-				if (ptr->getFaderValue(mix, index, temp, num)) {
-					assert(num <= HPSJAM_MAX_PKT);
-					if (mix != 0 || num <= 0)
-						break;
-					if (index + num > HPSJAM_PEERS_MAX)
-						break;
-					for (size_t x = 0; x != num; x++)
-						emit receivedFaderGain(mix, index + x, temp[x]);
-				}
-				break;
-			case HPSJAM_TYPE_FADER_PAN_REPLY:
-				if (ptr->getFaderValue(mix, index, temp, num)) {
-					assert(num <= HPSJAM_MAX_PKT);
-					if (mix != 0 || num <= 0)
-						break;
-					if (index + num > HPSJAM_PEERS_MAX)
-						break;
-					for (size_t x = 0; x != num; x++)
-						emit receivedFaderPan(mix, index + x, temp[x]);
-				}
-				break;
-			case HPSJAM_TYPE_FADER_LEVEL_REPLY:
-				if (ptr->getFaderValue(mix, index, temp, num)) {
-					assert(num <= HPSJAM_MAX_PKT);
-					if (mix != 0 || (num % 2) != 0 || num <= 0)
-						break;
-					if (index + (num / 2) > HPSJAM_PEERS_MAX)
-						break;
-					for (size_t x = 0; x != (num / 2); x++)
-						emit receivedFaderLevel(mix, index + x, temp[2 * x], temp[2 * x + 1]);
-				}
-				break;
-			case HPSJAM_TYPE_LOCAL_GAIN_REPLY:
-				if (ptr->getFaderValue(mix, index, temp, num)) {
-					assert(num <= HPSJAM_MAX_PKT);
-					if (mix != 0 || index != 0 || num != 1)
-						break;
-					in_gain = temp[0];
-				}
-				break;
-			case HPSJAM_TYPE_LOCAL_PAN_REPLY:
-				if (ptr->getFaderValue(mix, index, temp, num)) {
-					assert(num <= HPSJAM_MAX_PKT);
-					if (mix != 0 || index != 0 || num != 1)
-						break;
-					in_pan = temp[0];
-				}
-				break;
-			case HPSJAM_TYPE_FADER_EQ_REPLY:
-				if (ptr->getFaderData(mix, index, &data, num)) {
-					if (mix != 0)
-						break;
-					QByteArray t(data, num);
-					emit receivedFaderEQ(mix, index, new QString(QString::fromLatin1(t)));
-				}
-				break;
-			case HPSJAM_TYPE_LOCAL_EQ_REPLY:
-				if (ptr->getFaderData(mix, index, &data, num)) {
-					if (mix != 0 || index != 0)
-						break;
-					char *ptr = new char [num + 1];
-					memcpy(ptr, data, num);
-					ptr[num] = 0;
-					eq.init(ptr);
-					delete [] ptr;
-				}
-				break;
-			case HPSJAM_TYPE_FADER_DISCONNECT_REPLY:
-				if (ptr->getFaderData(mix, index, &data, num)) {
-					if (mix != 0)
-						break;
-					emit receivedFaderDisconnect(mix, index);
-				}
-				break;
-			case HPSJAM_TYPE_SET_PORT_ORDER_REQUEST:
-				if (ptr->getPortOrder(output_pkt.port_mapping, HPSJAM_PORTS_MAX)) {
-					pres = new struct hpsjam_packet_entry;
-					pres->packet.length = 1;
-					pres->packet.sequence[0] = 0;
-					pres->packet.sequence[1] = 0;
-					pres->packet.type = HPSJAM_TYPE_SET_PORT_ORDER_REPLY;
-					pres->insert_tail(&output_pkt.head);
-				}
-				break;
-			case HPSJAM_TYPE_SET_PORT_ORDER_REPLY:
-				input_pkt.reset_time_variance();
-				break;
-			default:
-				break;
+			receive_sequenced(ptr);
+
+			/* process buffered packets which are now in order */
+			while ((pdata = output_pkt.rx_next())) {
+				receive_sequenced(&pdata->packet);
+				pdata->unref();
 			}
 		}
 	}
@@ -1653,8 +1909,8 @@ hpsjam_client_peer :: tick()
 	/* send a ping, if idle */
 	if (output_pkt.empty()) {
 		pres = new struct hpsjam_packet_entry;
-		pres->packet.setPing(0, hpsjam_ticks, 0, 0);
-		pres->packet.type = HPSJAM_TYPE_PING_REQUEST;
+		pres->data->packet.setPing(0, hpsjam_ticks, 0, 0);
+		pres->data->packet.type = HPSJAM_TYPE_PING_REQUEST;
 		pres->insert_tail(&output_pkt.head);
 	}
 
@@ -1668,11 +1924,10 @@ hpsjam_client_peer :: tick()
 	}
 
 	/* extract samples for this tick */
-	out_audio[0].remSamples(audio[0], HPSJAM_DEF_SAMPLES);
-	out_audio[1].remSamples(audio[1], HPSJAM_DEF_SAMPLES);
+	out_audio.remSamples(audio[0], audio[1], HPSJAM_DEF_SAMPLES);
 
 	/* check if we should adjust the timer, based on current audio input buffer */
-	switch (out_audio[0].getLowWater()) {
+	switch (out_audio.getLowWater()) {
 	case hpsjam_audio_buffer::WATER_LOW:
 		hpsjam_timer_adjust = 1;	/* go slower */
 		break;
@@ -1692,13 +1947,17 @@ hpsjam_client_peer :: tick()
 	HpsJamSendPacket
 	    <class hpsjam_client_peer>(*this);
 
-	/* Adjust all buffers every 16 seconds approximately. */
+	/* Adjust all buffers every 4 seconds approximately. */
 	if ((hpsjam_ticks & HPSJAM_ADJUST_TICKS) == 0) {
-		out_audio[0].adjustBuffer();
-		out_audio[1].adjustBuffer();
-		in_audio[0].adjustBuffer();
-		in_audio[1].adjustBuffer();
+		HpsJamAdaptWaterTarget
+		    <class hpsjam_client_peer>(*this);
+
+		out_audio.adjustBuffer();
+		in_audio.adjustBuffer();
+	}
 
+	/* Check the port order every 16 seconds approximately. */
+	if ((hpsjam_ticks & HPSJAM_PORT_ORDER_TICKS) == 0) {
 		HpsJamSendPortOrderRequest
 		    <class hpsjam_client_peer>(*this);
 	}
@@ -1718,6 +1977,92 @@ hpsjam_client_peer :: handleLyrics(QString *str)
 	delete str;
 }
 
+static int
+hpsjam_cli_pool_report(char *buf, size_t size, const char *name, const struct hpsjam_pool &pool)
+{
+	return (snprintf(buf, size, "%s: %u items of %zu bytes, "
+	    "%u in use, %u max in use, %llu allocations, %llu exhausted\n",
+	    name, pool.count, pool.size, pool.in_use.load(), pool.max_use.load(),
+	    (unsigned long long)pool.allocs.load(),
+	    (unsigned long long)pool.exhausted.load()));
+}
+
+static void
+hpsjam_cli_memory_report(const struct hpsjam_socket_address &addr)
+{
+	char buffer[HPSJAM_MAX_UDP];
+	size_t off = 0;
+	int ret;
+
+	if (hpsjam_num_server_peers == 0) {
+		const size_t total = sizeof(class hpsjam_client_peer) +
+		    sizeof(struct hpsjam_input_packetizer) +
+		    2 * sizeof(class hpsjam_equalizer_switch);
+
+		ret = snprintf(buffer, sizeof(buffer),
+		    "client peer: %zu bytes\n", total);
+	} else {
+		const size_t peer_bytes = hpsjam_num_server_peers * sizeof(class hpsjam_server_peer);
+		unsigned pool_used;
+		unsigned pool_free;
+		unsigned connected = 0;
+		unsigned equalizers = 0;
+		size_t eq_bytes = 0;
+
+		hpsjam_input_pool_lock.lock();
+		pool_used = hpsjam_input_pool_used;
+		pool_free = hpsjam_input_pool_free;
+		hpsjam_input_pool_lock.unlock();
+
+		/* only count what is allocated on connect */
+		for (unsigned x = 0; x != hpsjam_num_server_peers; x++) {
+			class hpsjam_server_peer &peer = hpsjam_server_peers[x];
+			QMutexLocker locker(&peer.lock);
+
+			if (peer.valid == false)
+				continue;
+			connected++;
+			eq_bytes += peer.eq_size;
+			if (peer.eq != 0) {
+				eq_bytes += sizeof(class hpsjam_equalizer_switch);
+				equalizers++;
+			}
+		}
+
+		const size_t pkt_bytes = (pool_used + pool_free) *
+		    sizeof(struct hpsjam_input_packetizer);
+
+		ret = snprintf(buffer, sizeof(buffer),
+		    "server peers: %u of %u connected, %zu bytes of slots\n"
+		    "input packetizers: %u in use, %u free, %zu bytes\n"
+		    "equalizers: %u allocated, %zu bytes\n"
+		    "total: %zu bytes\n",
+		    connected, hpsjam_num_server_peers, peer_bytes,
+		    pool_used, pool_free, pkt_bytes,
+		    equalizers, eq_bytes,
+		    peer_bytes + pkt_bytes + eq_bytes);
+	}
+	if (ret > 0)
+		off += ret;
+
+	if (off < sizeof(buffer)) {
+		ret = hpsjam_cli_pool_report(buffer + off, sizeof(buffer) - off,
+		    "packet payloads", hpsjam_packet_pool);
+		if (ret > 0)
+			off += ret;
+	}
+	if (off < sizeof(buffer)) {
+		ret = hpsjam_cli_pool_report(buffer + off, sizeof(buffer) - off,
+		    "packet entries", hpsjam_packet_node_pool);
+		if (ret > 0)
+			off += ret;
+	}
+	if (off > sizeof(buffer) - 1)
+		off = sizeof(buffer) - 1;
+
+	addr.sendto(buffer, off);
+}
+
 void
 hpsjam_cli_process(const struct hpsjam_socket_address &addr, const char *data, size_t len)
 {
@@ -1737,14 +2082,14 @@ hpsjam_cli_process(const struct hpsjam_socket_address &addr, const char *data, s
 			if (hpsjam_client_peer->address[0].valid()) {
 				/* send text */
 				pkt = new struct hpsjam_packet_entry;
-				pkt->packet.setRawData(temp.constData() + 16, temp.length() - 16);
-				pkt->packet.type = HPSJAM_TYPE_LYRICS_REQUEST;
+				pkt->data->packet.setRawData(temp.constData() + 16, temp.length() - 16);
+				pkt->data->packet.type = HPSJAM_TYPE_LYRICS_REQUEST;
 				pkt->insert_tail(&hpsjam_client_peer->output_pkt.head);
 			}
 		} else {
 			pkt = new struct hpsjam_packet_entry;
-			pkt->packet.setRawData(temp.constData() + 16, temp.length() - 16);
-			pkt->packet.type = HPSJAM_TYPE_LYRICS_REPLY;
+			pkt->data->packet.setRawData(temp.constData() + 16, temp.length() - 16);
+			pkt->data->packet.type = HPSJAM_TYPE_LYRICS_REPLY;
 			hpsjam_server_broadcast(*pkt);
 			delete pkt;
 		}
@@ -1756,6 +2101,8 @@ hpsjam_cli_process(const struct hpsjam_socket_address &addr, const char *data, s
 		} else if (id > 0 && id <= (int)hpsjam_num_server_peers) {
 			emit hpsjam_server_peers[id - 1].output_pkt.pendingTimeout();
 		}
+	} else if (str.startsWith("get allocated")) {
+		hpsjam_cli_memory_report(addr);
 	}
 }
 
@@ -44,34 +44,41 @@ struct hpsjam_server_default_mix {
 	float out_audio[2][64];
 };
 
+extern struct hpsjam_input_packetizer *hpsjam_input_pkt_alloc();
+extern void hpsjam_input_pkt_free(struct hpsjam_input_packetizer *);
+
 class hpsjam_server_peer : public QObject {
 	Q_OBJECT
 public:
 	QMutex lock;
 	struct hpsjam_socket_address address[HPSJAM_PORTS_MAX];
-	struct hpsjam_input_packetizer input_pkt;
+	struct hpsjam_input_packetizer *input_pkt;	/* only set when valid */
 	class hpsjam_output_packetizer output_pkt;
 	class hpsjam_midi_buffer in_midi;
-	class hpsjam_audio_buffer in_audio[2];
-	class hpsjam_audio_buffer out_buffer[2];
+	class hpsjam_audio_buffer in_audio;
+	class hpsjam_audio_buffer out_buffer;
 	class hpsjam_audio_level in_level[2];
 #if (HPSJAM_DEF_SAMPLES > 64)
 #error "Please update the two arrays below"
 #endif
-	float tmp_audio[2][64];
-	float out_audio[2][64];
+	float tmp_audio[2][64];	/* only left is used when mono */
+	float out_audio[2][64];	/* only left is used when mono */
 
 	QString name;
 	QByteArray icon;
 	uint8_t bits[HPSJAM_PEERS_MAX];
 	bool multi_port;
+	bool telemetry;
+	bool level_rms;
 	uint32_t multi_wait;
 	float gain;
 	float pan;
 	char *eq_data;
 	size_t eq_size;
+	class hpsjam_equalizer_switch *eq;	/* only used by server processing */
 	float out_peak;
 	uint8_t output_fmt;
+	bool tmp_mono;
 	bool valid;
 	bool allow_mixer_access;
 
@@ -79,16 +86,19 @@ public:
 		for (unsigned i = 0; i != HPSJAM_PORTS_MAX; i++)
 			address[i].clear();
 		multi_port = false;
+		telemetry = false;
+		level_rms = false;
 		multi_wait = 1000;
-		input_pkt.init();
+		hpsjam_input_pkt_free(input_pkt);
+		input_pkt = 0;
 		output_pkt.init();
-		in_audio[0].clear();
-		in_audio[1].clear();
-		out_buffer[0].clear();
-		out_buffer[1].clear();
+		in_audio.clear();
+		in_audio.setConcealment(hpsjam_loss_concealment);
+		out_buffer.clear();
 		in_level[0].clear();
 		in_level[1].clear();
 		memset(out_audio, 0, sizeof(out_audio));
+		tmp_mono = true;
 		name = QString();
 		icon = QByteArray();
 		memset(bits, 0, sizeof(bits));
@@ -97,6 +107,8 @@ public:
 		pan = 0.0f;
 		eq_data = 0;
 		eq_size = 0;
+		hpsjam_equalizer_switch_free(eq);
+		eq = 0;
 		out_peak = 0.0f;
 		valid = false;
 		allow_mixer_access = false;
@@ -104,13 +116,23 @@ public:
 
 	size_t serverID();
 
+	void receive_levels(const struct hpsjam_packet *) {
+		/* not used by server */
+	};
+	void receive_rms_levels(const struct hpsjam_packet *) {
+		/* not used by server */
+	};
+	void receive_sequenced(const struct hpsjam_packet *);
 	void audio_export();
+	void audio_process();
 	void audio_import();
 	void audio_mixing();
 	void send_welcome_message();
 	void send_mixer_parameters();
 
 	hpsjam_server_peer() {
+		input_pkt = 0;
+		eq = 0;
 		init();
 		connect(&output_pkt, SIGNAL(pendingWatchdog()), this, SLOT(handle_pending_watchdog()));
 		connect(&output_pkt, SIGNAL(pendingTimeout()), this, SLOT(handle_pending_timeout()));
@@ -159,17 +181,17 @@ class hpsjam_client_peer : public QObject {
 public:
 	QMutex lock;
 	struct hpsjam_socket_address address[HPSJAM_PORTS_MAX];
-	struct hpsjam_input_packetizer input_pkt;
+	struct hpsjam_input_packetizer *input_pkt;
 	class hpsjam_output_packetizer output_pkt;
 	struct hpsjam_midi_parse in_midi_parse;
 	class hpsjam_midi_buffer in_midi;
-	class hpsjam_audio_buffer in_audio[2];
+	class hpsjam_audio_buffer in_audio;
 	class hpsjam_audio_level in_level[2];
-	class hpsjam_audio_buffer out_buffer[2];
-	class hpsjam_audio_buffer out_audio[2];
+	class hpsjam_audio_buffer out_buffer;
+	class hpsjam_audio_buffer out_audio;
 	class hpsjam_audio_level out_level[2];
-	class hpsjam_equalizer local_eq;
-	class hpsjam_equalizer eq;
+	class hpsjam_equalizer_switch *local_eq;
+	class hpsjam_equalizer_switch *eq;
 	class hpsjam_client_audio_effects audio_effects;
 	float mon_gain[2];
 	float mon_pan;
@@ -188,18 +210,15 @@ public:
 	void init() {
 		for (unsigned i = 0; i != HPSJAM_PORTS_MAX; i++)
 			address[i].clear();
-		input_pkt.init();
+		input_pkt->init();
 		output_pkt.init();
 		in_midi_parse.clear();
 		in_midi.clear();
-		in_audio[0].clear();
-		in_audio[1].clear();
+		in_audio.clear();
 		in_level[0].clear();
 		in_level[1].clear();
-		out_buffer[0].clear();
-		out_buffer[1].clear();
-		out_audio[0].clear();
-		out_audio[1].clear();
+		out_buffer.clear();
+		out_audio.clear();
 		out_level[0].clear();
 		out_level[1].clear();
 		in_gain = 1.0f;
@@ -215,11 +234,17 @@ public:
 		multi_port = false;
 		multi_wait = 0;
 		bits = 0;
-		eq.cleanup();
-		local_eq.cleanup();
+		hpsjam_equalizer_switch_free(eq);
+		eq = new class hpsjam_equalizer_switch;
+		hpsjam_equalizer_switch_free(local_eq);
+		local_eq = new class hpsjam_equalizer_switch;
 		self_index = -1;
 	};
 	hpsjam_client_peer() {
+		input_pkt = new struct hpsjam_input_packetizer;
+		eq = 0;
+		local_eq = 0;
+		in_audio.setConcealment(hpsjam_loss_concealment);
 		init();
 
 		connect(&output_pkt, SIGNAL(pendingWatchdog()), this, SLOT(handle_pending_watchdog()));
@@ -228,16 +253,19 @@ public:
 	};
 	void sound_process(float *, float *, size_t);
 	int midi_process(uint8_t *);
+	void receive_levels(const struct hpsjam_packet *);
+	void receive_rms_levels(const struct hpsjam_packet *);
+	void receive_sequenced(const struct hpsjam_packet *);
 	void tick();
 	void send_single_pkt(struct hpsjam_packet_entry *pkt) {
 		QMutexLocker locker(&lock);
 		if (address[0].valid()) {
 			struct hpsjam_packet_entry *ptr =
-			    output_pkt.find(pkt->packet.type);
+			    output_pkt.find(pkt->data->packet.type);
 
 			/* check if packets can be coalesched */
 			if (ptr != 0) {
-				memcpy(ptr->raw, pkt->raw, sizeof(ptr->raw));
+				HPSJAM_SWAP(ptr->data, pkt->data);
 				delete pkt;
 			} else {
 				pkt->insert_tail(&output_pkt.head);
@@ -255,6 +283,7 @@ signals:
 	void receivedChat(QString *);
 	void receivedLyrics(QString *);
 	void receivedFaderLevel(uint8_t, uint8_t, float, float);
+	void receivedFaderRMS(uint8_t, uint8_t, float, float);
 	void receivedFaderName(uint8_t, uint8_t, QString *);
 	void receivedFaderIcon(uint8_t, uint8_t, QByteArray *);
 	void receivedFaderGain(uint8_t, uint8_t, float);
@@ -268,7 +297,7 @@ extern hpsjam_midi_buffer *hpsjam_default_midi;
 
 extern void hpsjam_cli_process(const struct hpsjam_socket_address &, const char *, size_t);
 extern void hpsjam_peer_receive(const struct hpsjam_socket_address &,
-    const struct hpsjam_socket_address &, const union hpsjam_frame &);
+    const struct hpsjam_socket_address &, const union hpsjam_frame &, size_t);
 extern bool hpsjam_server_tick();
 
 #endif		/* _HPSJAM_PEER_H_ */
@@ -0,0 +1,100 @@
+/*-
+ * Copyright (c) 2022 Hans Petter Selasky. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+
+#include "pool.h"
+
+void
+hpsjam_pool :: init(uint32_t _count)
+{
+	count = _count;
+	data = (uint8_t *)malloc(size * count);
+	next = new std::atomic<uint32_t> [count];
+
+	/* chain all items */
+	for (uint32_t x = 0; x != count; x++)
+		next[x].store(x + 1 == count ? 0 : x + 2, std::memory_order_relaxed);
+
+	in_use.store(0);
+	max_use.store(0);
+	allocs.store(0);
+	exhausted.store(0);
+	head.store(count ? 1 : 0);
+}
+
+void *
+hpsjam_pool :: alloc()
+{
+	uint64_t old = head.load(std::memory_order_acquire);
+	uint64_t fresh;
+	uint32_t index;
+
+	allocs.fetch_add(1, std::memory_order_relaxed);
+
+	do {
+		index = (uint32_t)old;
+		if (index == 0) {
+			exhausted.fetch_add(1, std::memory_order_relaxed);
+			return (malloc(size));
+		}
+		/* bump the tag to avoid the ABA problem */
+		fresh = ((old >> 32) + 1) << 32 |
+		    next[index - 1].load(std::memory_order_relaxed);
+	} while (!head.compare_exchange_weak(old, fresh,
+	    std::memory_order_acquire, std::memory_order_acquire));
+
+	uint32_t use = in_use.fetch_add(1, std::memory_order_relaxed) + 1;
+	uint32_t max = max_use.load(std::memory_order_relaxed);
+	while (use > max && !max_use.compare_exchange_weak(max, use,
+	    std::memory_order_relaxed))
+		;
+	return (data + (index - 1) * size);
+}
+
+void
+hpsjam_pool :: free(void *ptr)
+{
+	uint64_t old = head.load(std::memory_order_relaxed);
+	uint64_t fresh;
+	uint32_t index;
+
+	if (ptr == 0)
+		return;
+	if (!owns(ptr)) {
+		::free(ptr);
+		return;
+	}
+
+	index = ((uint8_t *)ptr - data) / size;
+
+	do {
+		next[index].store((uint32_t)old, std::memory_order_relaxed);
+		fresh = ((old >> 32) + 1) << 32 | (index + 1);
+	} while (!head.compare_exchange_weak(old, fresh,
+	    std::memory_order_release, std::memory_order_relaxed));
+
+	in_use.fetch_sub(1, std::memory_order_relaxed);
+}
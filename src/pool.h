@@ -0,0 +1,66 @@
+/*-
+ * Copyright (c) 2022 Hans Petter Selasky. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	_HPSJAM_POOL_H_
+#define	_HPSJAM_POOL_H_
+
+#include <atomic>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Fixed size, lock-free memory pool. All items are preallocated
+ * by init(). When the pool is exhausted, alloc() falls back to the
+ * heap and counts the event, so that callers never fail.
+ */
+struct hpsjam_pool {
+	uint8_t *data;
+	std::atomic<uint32_t> *next;
+	std::atomic<uint64_t> head;	/* tag in upper, index + 1 in lower 32 bits */
+	std::atomic<uint32_t> in_use;
+	std::atomic<uint32_t> max_use;
+	std::atomic<uint64_t> allocs;
+	std::atomic<uint64_t> exhausted;
+	size_t size;	/* size of item in bytes */
+	uint32_t count;	/* number of items */
+
+	hpsjam_pool(size_t _size) : data(0), next(0), head(0), in_use(0),
+	    max_use(0), allocs(0), exhausted(0), count(0) {
+		/* keep items 16-byte aligned */
+		size = (_size + 15) & ~(size_t)15;
+	};
+
+	void init(uint32_t);
+
+	bool owns(const void *ptr) const {
+		return ((uintptr_t)ptr - (uintptr_t)data < (uintptr_t)size * count);
+	};
+
+	void *alloc();
+	void free(void *);
+};
+
+#endif		/* _HPSJAM_POOL_H_ */
@@ -36,6 +36,33 @@ static float hpsjam_mul_16;
 static float hpsjam_mul_24;
 static float hpsjam_mul_32;
 
+struct hpsjam_pool hpsjam_packet_pool(sizeof(struct hpsjam_packet_data));
+struct hpsjam_pool hpsjam_packet_node_pool(sizeof(struct hpsjam_packet_entry));
+
+void *
+hpsjam_packet_data :: operator new(size_t)
+{
+	return (hpsjam_packet_pool.alloc());
+}
+
+void
+hpsjam_packet_data :: operator delete(void *ptr)
+{
+	hpsjam_packet_pool.free(ptr);
+}
+
+void *
+hpsjam_packet_entry :: operator new(size_t)
+{
+	return (hpsjam_packet_node_pool.alloc());
+}
+
+void
+hpsjam_packet_entry :: operator delete(void *ptr)
+{
+	hpsjam_packet_node_pool.free(ptr);
+}
+
 static void __attribute__((__constructor__))
 audio_init(void)
 {
@@ -303,6 +330,13 @@ hpsjam_packet::putSilence(size_t samples)
 	sequence[1] = 0;
 }
 
+void
+hpsjam_packet::putLoss(size_t samples)
+{
+	putSilence(samples);
+	type = HPSJAM_TYPE_AUDIO_LOSS;
+}
+
 void
 hpsjam_packet::putMidiData(const uint8_t *ptr, size_t bytes)
 {
@@ -496,55 +530,90 @@ hpsjam_packet::getPortOrder(uint8_t *dst, size_t max) const
 	return (false);
 }
 
+const union hpsjam_frame *
+hpsjam_input_packetizer::get_frame(unsigned x)
+{
+	const size_t len = slot[x].len;
+
+	output.hdr.setSequence(x);
+	memcpy(output.start, getData(x), len);
+	output.terminate(len);
+	return (&output);
+}
+
+const union hpsjam_frame *
+hpsjam_input_packetizer::get_xor_frame(unsigned x, unsigned y)
+{
+	const uint8_t *px = getData(x);
+	const uint8_t *py = getData(y);
+	size_t lx = slot[x].len;
+	size_t ly = slot[y].len;
+	size_t len = (lx > ly) ? lx : ly;
+	size_t z;
+
+	output.hdr.setSequence(x);
+	if (lx < ly) {
+		HPSJAM_SWAP(px, py);
+		HPSJAM_SWAP(lx, ly);
+	}
+	/* only process the actual lengths */
+	for (z = 0; z != ly; z++)
+		output.raw[sizeof(output.hdr) + z] = px[z] ^ py[z];
+	memcpy(output.raw + sizeof(output.hdr) + ly, px + ly, lx - ly);
+	output.terminate(len);
+	return (&output);
+}
+
+static inline uint64_t
+hpsjam_group_rotr(uint64_t mask, unsigned n)
+{
+	constexpr uint64_t full = (1ULL << HPSJAM_GROUP_MAX) - 1ULL;
+
+	n %= HPSJAM_GROUP_MAX;
+	if (n == 0)
+		return (mask);
+	return (((mask >> n) | (mask << (HPSJAM_GROUP_MAX - n))) & full);
+}
+
 const union hpsjam_frame *
 hpsjam_input_packetizer::first_pkt(bool low_water)
 {
 	enum {
-		NMAX = 5,
-		BMAX = HPSJAM_SEQ_MAX / NMAX
+		NMAX = HPSJAM_GROUP_FRAMES,
 	};
 	uint64_t mask;
+	uint64_t cand;
 	uint64_t start;
 	unsigned min_x;
 	unsigned delta;
 	unsigned x;
-	unsigned y;
-
-	mask = 0;
-	for (x = 0; x != BMAX; x++) {
-		for (y = 0; y != NMAX; y++) {
-			if (valid[NMAX * x + y] == HPSJAM_MASK_VALID) {
-				mask |= 1ULL << x;
-				break;
-			}
-		}
-	}
 
 	/* check if no packets can be received */
-	if (mask == 0)
+	if (group_mask == 0)
 		return (NULL);
 
 	/* try to continue at the last sequence number */
-	mask |= 1ULL << (last_seqno / NMAX);
+	mask = group_mask | (1ULL << (last_seqno / NMAX));
 
 	/*
 	 * Figure out the rotation which gives the smallest
 	 * value. This gives an indication where to start
-	 * reading the frames:
+	 * reading the frames. The smallest value always
+	 * starts at a set bit preceded by a cleared bit, so
+	 * only those positions need to be considered:
 	 */
+	cand = mask & ~hpsjam_group_rotr(mask, HPSJAM_GROUP_MAX - 1);
 	start = mask;
 	min_x = 0;
-	for (x = 0; x != BMAX; x++) {
-		if (start > mask) {
-			start = mask;
+	while (cand != 0) {
+		x = __builtin_ctzll(cand);
+		cand &= cand - 1;
+
+		const uint64_t temp = hpsjam_group_rotr(mask, x);
+		if (start > temp) {
+			start = temp;
 			min_x = x;
 		}
-		if (mask & 1) {
-			mask >>= 1;
-			mask |= 1ULL << (BMAX - 1);
-		} else {
-			mask >>= 1;
-		}
 	}
 
 	for (x = min_x * NMAX;;) {
@@ -556,23 +625,23 @@ hpsjam_input_packetizer::first_pkt(bool low_water)
 			if (delta >= (HPSJAM_SEQ_MAX / 2))
 				break;
 
-			if (valid[x] & HPSJAM_MASK_VALID) {
+			if (isValid(x)) {
 				/* got frame */
 				last_seqno = (x + 1) % HPSJAM_SEQ_MAX;
-				return (current + x);
-			} else if (valid[x + 1] & valid[x + 2] & HPSJAM_MASK_VALID) {
+				return (get_frame(x));
+			} else if (isValid(x + 1) && isValid(x + 2)) {
 				/* can recover */
 				last_seqno = (x + 1) % HPSJAM_SEQ_MAX;
-				current[x + 2].do_xor(current[x + 1]);
 				jitter.rx_recover();
-				return (current + x + 2);
+				return (get_xor_frame(x + 2, x + 1));
 			} else if (low_water) {
 				last_seqno = (x + 1) % HPSJAM_SEQ_MAX;
 				jitter.rx_damage();
-				/* fill frame with silence */
-				current[x].clear();
-				current[x].start[0].putSilence(HPSJAM_NOM_SAMPLES);
-				return (current + x);
+				/* let the receiver conceal the lost frame */
+				output.hdr.setSequence(x);
+				output.start[0].putLoss(HPSJAM_NOM_SAMPLES);
+				output.terminate(output.start[0].getBytes());
+				return (&output);
 			} else {
 				/* wait a bit for packet */
 				return (NULL);
@@ -582,23 +651,23 @@ hpsjam_input_packetizer::first_pkt(bool low_water)
 			if (delta >= (HPSJAM_SEQ_MAX / 2))
 				break;
 
-			if (valid[x] & HPSJAM_MASK_VALID) {
+			if (isValid(x)) {
 				/* got frame */
 				last_seqno = (x + 1) % HPSJAM_SEQ_MAX;
-				return (current + x);
-			} else if (valid[x - 1] & valid[x + 1] & HPSJAM_MASK_VALID) {
+				return (get_frame(x));
+			} else if (isValid(x - 1) && isValid(x + 1)) {
 				/* can recover */
 				last_seqno = (x + 1) % HPSJAM_SEQ_MAX;
-				current[x + 1].do_xor(current[x - 1]);
 				jitter.rx_recover();
-				return (current + x + 1);
+				return (get_xor_frame(x + 1, x - 1));
 			} else if (low_water) {
 				last_seqno = (x + 1) % HPSJAM_SEQ_MAX;
 				jitter.rx_damage();
-				/* fill frame with silence */
-				current[x].clear();
-				current[x].start[0].putSilence(HPSJAM_NOM_SAMPLES);
-				return (current + x);
+				/* let the receiver conceal the lost frame */
+				output.hdr.setSequence(x);
+				output.start[0].putLoss(HPSJAM_NOM_SAMPLES);
+				output.terminate(output.start[0].getBytes());
+				return (&output);
 			} else {
 				/* wait a bit for packet */
 				return (NULL);
@@ -608,9 +677,9 @@ hpsjam_input_packetizer::first_pkt(bool low_water)
 			if (delta < (HPSJAM_SEQ_MAX / 2))
 				last_seqno = (x + 1) % HPSJAM_SEQ_MAX;
 
-			valid[x - 2] &= ~HPSJAM_MASK_VALID;
-			valid[x - 1] &= ~HPSJAM_MASK_VALID;
-			valid[x - 0] &= ~HPSJAM_MASK_VALID;
+			clearValid(x - 2);
+			clearValid(x - 1);
+			clearValid(x - 0);
 			break;
 		}
 		x++;
@@ -31,6 +31,7 @@
 #include "hpsjam.h"
 #include "socket.h"
 #include "jitter.h"
+#include "pool.h"
 
 #include <assert.h>
 
@@ -40,6 +41,11 @@
 #include <sys/queue.h>
 
 #define	HPSJAM_MAX_PKT (255 * 4)
+#define	HPSJAM_POOL_PKT_MIN 256	/* preallocated packets */
+#define	HPSJAM_POOL_PKT_PEER 32	/* preallocated queue entries per server peer */
+#define	HPSJAM_POOL_DATA_PEER 8	/* preallocated payloads per server peer */
+#define	HPSJAM_WINDOW_MAX 32	/* maximum control packets in flight */
+#define	HPSJAM_ARENA_SIZE 65536	/* bytes of received frames per peer */
 
 enum {
 	HPSJAM_TYPE_END,
@@ -51,6 +57,10 @@ enum {
 	HPSJAM_TYPE_AUDIO_24_BIT_2CH,
 	HPSJAM_TYPE_AUDIO_32_BIT_1CH,
 	HPSJAM_TYPE_AUDIO_32_BIT_2CH,
+	HPSJAM_TYPE_FADER_RMS_TELEMETRY = 56,
+	HPSJAM_TYPE_AUDIO_LOSS = 57,	/* local only, lost audio frame */
+	HPSJAM_TYPE_SELECTIVE_ACK = 58,
+	HPSJAM_TYPE_FADER_LEVEL_TELEMETRY = 59,
 	HPSJAM_TYPE_AUDIO_MAX = 60,
 	HPSJAM_TYPE_MIDI_PACKET = 61,
 	HPSJAM_TYPE_AUDIO_SILENCE = 62,
@@ -83,6 +93,20 @@ enum {
 	HPSJAM_TYPE_SET_PORT_ORDER_REPLY,
 };
 
+static inline bool
+hpsjam_audio_format_is_mono(uint8_t type)
+{
+	switch (type) {
+	case HPSJAM_TYPE_AUDIO_8_BIT_1CH:
+	case HPSJAM_TYPE_AUDIO_16_BIT_1CH:
+	case HPSJAM_TYPE_AUDIO_24_BIT_1CH:
+	case HPSJAM_TYPE_AUDIO_32_BIT_1CH:
+		return (true);
+	default:
+		return (false);
+	}
+}
+
 struct hpsjam_header {
 	uint8_t sequence;
 	void clear() {
@@ -184,6 +208,7 @@ struct hpsjam_packet {
 	void put32Bit1ChSample(float *left, size_t samples);
 
 	void putSilence(size_t samples);
+	void putLoss(size_t samples);
 
 	void putMidiData(const uint8_t *, size_t);
 	bool getMidiData(uint8_t *, size_t *) const;
@@ -260,15 +285,49 @@ struct hpsjam_packet {
 	bool getPortOrder(uint8_t *, size_t) const;
 };
 
+/* immutable, reference counted packet payload */
+struct hpsjam_packet_data {
+	std::atomic<uint32_t> refs;
+	union {
+		struct hpsjam_packet packet;
+		uint8_t raw[HPSJAM_MAX_PKT];
+	};
+
+	hpsjam_packet_data() : refs(1) {};
+
+	static void *operator new(size_t);
+	static void operator delete(void *);
+
+	struct hpsjam_packet_data *ref() {
+		refs.fetch_add(1, std::memory_order_relaxed);
+		return (this);
+	};
+	void unref() {
+		if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			delete this;
+	};
+};
+
 struct hpsjam_packet_entry;
 typedef TAILQ_HEAD(, hpsjam_packet_entry) hpsjam_packet_head_t;
 
+/* per-peer queue element, which may share its payload with other peers */
 struct hpsjam_packet_entry {
 	TAILQ_ENTRY(hpsjam_packet_entry) entry;
-	union {
-		struct hpsjam_packet packet;
-		uint8_t raw[HPSJAM_MAX_PKT];
+	struct hpsjam_packet_data *data;
+	uint8_t seqno;	/* local sequence number */
+
+	hpsjam_packet_entry() : data(new struct hpsjam_packet_data), seqno(0) {};
+	hpsjam_packet_entry(struct hpsjam_packet_data *_data) : data(_data->ref()), seqno(0) {};
+	hpsjam_packet_entry(const struct hpsjam_packet_entry &) = delete;
+	hpsjam_packet_entry & operator =(const struct hpsjam_packet_entry &) = delete;
+	~hpsjam_packet_entry() {
+		data->unref();
 	};
+
+	static void *operator new(size_t);
+	static void operator delete(void *);
+
 	struct hpsjam_packet_entry & insert_tail(hpsjam_packet_head_t *phead)
 	{
 		TAILQ_INSERT_TAIL(phead, this, entry);
@@ -286,6 +345,9 @@ struct hpsjam_packet_entry {
 	};
 };
 
+extern struct hpsjam_pool hpsjam_packet_pool;
+extern struct hpsjam_pool hpsjam_packet_node_pool;
+
 union hpsjam_frame {
 	uint8_t raw[HPSJAM_MAX_UDP];
 	uint32_t raw32[HPSJAM_MAX_UDP / 4];
@@ -298,26 +360,42 @@ union hpsjam_frame {
 		struct hpsjam_packet start[(HPSJAM_MAX_UDP - sizeof(hdr)) / sizeof(hpsjam_packet)];
 		struct hpsjam_packet end[0];
 	};
-	void clear() {
-		memset(this, 0, sizeof(*this));
+	void clear(size_t len = sizeof(hpsjam_frame)) {
+		memset(this, 0, len);
 	};
-	void do_xor(const union hpsjam_frame &other) {
-		for (size_t x = 0; x != (sizeof(*this) / 8); x++)
+	void terminate(size_t len) {
+		/* zero the packet header following "len" bytes of data, if any */
+		const size_t max = sizeof(*this) - sizeof(hdr);
+		if (len < max)
+			memset(raw + sizeof(hdr) + len, 0, (max - len < 4) ? (max - len) : 4);
+	};
+	void do_xor(const union hpsjam_frame &other, size_t len = sizeof(hpsjam_frame)) {
+		for (size_t x = 0; x != (len + 7) / 8; x++)
 			raw64[x] ^= other.raw64[x];
 	};
 };
 
+struct hpsjam_window_slot {
+	struct hpsjam_packet_entry *pkt;
+	uint16_t first_time;	/* time of first transmit */
+	uint16_t send_time;	/* time of last transmit */
+	bool sacked;		/* selectively acknowledged */
+	bool resent;		/* packet was retransmitted */
+};
+
 class hpsjam_output_packetizer : public QObject {
 	Q_OBJECT
 public:
 	union hpsjam_frame current;
 	union hpsjam_frame mask;
 	hpsjam_packet_head_t head;
-	struct hpsjam_packet_entry *pending;
-	uint16_t start_time; /* start time for message */
+	struct hpsjam_window_slot window[HPSJAM_WINDOW_MAX];
+	struct hpsjam_packet_data *rx_window[HPSJAM_WINDOW_MAX];
+	struct hpsjam_packet_data *telemetry; /* latest best-effort packet */
 	uint16_t ping_time; /* response time in ticks */
 	uint16_t pend_count; /* pending timeout counter */
-	uint8_t pend_seqno; /* pending sequence number */
+	uint8_t pend_seqno; /* next local sequence number */
+	uint8_t ack_seqno; /* oldest unacknowledged sequence number */
 	uint8_t peer_seqno; /* peer sequence number */
 	uint8_t seqno;	/* current sequence number */
 	uint8_t port_mapping[HPSJAM_PORTS_MAX];
@@ -327,18 +405,24 @@ public:
 
 	hpsjam_output_packetizer() {
 		TAILQ_INIT(&head);
-		pending = 0;
+		memset(window, 0, sizeof(window));
+		memset(rx_window, 0, sizeof(rx_window));
+		telemetry = 0;
 		init();
 	};
 
+	uint8_t inflight() const {
+		return (pend_seqno - ack_seqno);
+	};
+
 	bool empty() const {
-		return (TAILQ_FIRST(&head) == 0);
+		return (TAILQ_FIRST(&head) == 0 && inflight() == 0);
 	};
 
 	struct hpsjam_packet_entry *find(uint8_t type) const {
 		struct hpsjam_packet_entry *pkt;
 		TAILQ_FOREACH(pkt, &head, entry) {
-			if (pkt->packet.type == type)
+			if (pkt->data->packet.type == type)
 				return (pkt);
 		}
 		return (0);
@@ -346,14 +430,15 @@ public:
 
 	void init() {
 		struct hpsjam_packet_entry *pkt;
-		start_time = 0;
 		ping_time = 0;
 		pend_count = 65535;
 		pend_seqno = 0;
+		ack_seqno = 0;
 		peer_seqno = 0;
 		seqno = 0;
 		send_ack = false;
 		offset = 0;
+		d_len = 0;
 		current.clear();
 		mask.clear();
 		for (unsigned x = 0; x != HPSJAM_PORTS_MAX; x++)
@@ -364,46 +449,164 @@ public:
 			delete pkt;
 		}
 
-		delete pending;
-		pending = 0;
+		for (unsigned x = 0; x != HPSJAM_WINDOW_MAX; x++) {
+			delete window[x].pkt;
+			window[x].pkt = 0;
+			if (rx_window[x] != 0)
+				rx_window[x]->unref();
+			rx_window[x] = 0;
+		}
+
+		if (telemetry != 0)
+			telemetry->unref();
+		telemetry = 0;
 	};
 
-	bool append_pkt(const struct hpsjam_packet_entry &entry)
+	/* replace any pending telemetry, which is never retransmitted */
+	void set_telemetry(struct hpsjam_packet_data *data) {
+		if (telemetry != 0)
+			telemetry->unref();
+		telemetry = data->ref();
+	};
+
+	bool can_append(size_t len) const {
+		return (len <= sizeof(current) - sizeof(current.hdr) - offset);
+	};
+
+	bool append_pkt(const struct hpsjam_packet &packet)
 	{
-		size_t remainder = sizeof(current) - sizeof(current.hdr) - offset;
-		size_t len = entry.packet.getBytes();
+		size_t len = packet.getBytes();
 
-		if (len <= remainder) {
-			memcpy(current.raw + sizeof(current.hdr) + offset, entry.raw, len);
+		if (can_append(len)) {
+			memcpy(current.raw + sizeof(current.hdr) + offset, &packet, len);
 			offset += len;
 			return (true);
 		}
 		return (false);
 	};
 
+	bool append_pkt(const struct hpsjam_packet_entry &entry)
+	{
+		struct hpsjam_packet *ptr = (struct hpsjam_packet *)
+		    (current.raw + sizeof(current.hdr) + offset);
+
+		if (append_pkt(entry.data->packet) == false)
+			return (false);
+		/* the payload is shared, so patch the sequence numbers in the frame */
+		ptr->setLocalSeqNo(entry.seqno);
+		ptr->setPeerSeqNo(peer_seqno);
+		return (true);
+	};
+
 	bool append_ack()
 	{
-		const size_t remainder = sizeof(current) - sizeof(current.hdr) - offset;
-		const size_t len = 4;
-
-		if (len <= remainder) {
-			uint8_t *ptr = current.raw + sizeof(current.hdr) + offset;
-			ptr[0] = 1;
-			ptr[1] = HPSJAM_TYPE_ACK;
-			ptr[2] = 0;
-			ptr[3] = peer_seqno;
-			offset += len;
+		uint32_t bitmap = 0;
+		uint8_t *ptr;
+
+		if (can_append(4) == false)
+			return (false);
+
+		ptr = current.raw + sizeof(current.hdr) + offset;
+		ptr[0] = 1;
+		ptr[1] = HPSJAM_TYPE_ACK;
+		ptr[2] = 0;
+		ptr[3] = peer_seqno;
+		offset += 4;
+
+		/* report out-of-order packets, if any */
+		for (unsigned x = 1; x != HPSJAM_WINDOW_MAX; x++) {
+			if (rx_window[(uint8_t)(peer_seqno + x) % HPSJAM_WINDOW_MAX] != 0)
+				bitmap |= 1U << (x - 1);
+		}
+		if (bitmap != 0 && can_append(8)) {
+			struct hpsjam_packet *pkt = (struct hpsjam_packet *)
+			    (current.raw + sizeof(current.hdr) + offset);
+			pkt->length = 2;
+			pkt->type = HPSJAM_TYPE_SELECTIVE_ACK;
+			pkt->setLocalSeqNo(0);
+			pkt->setPeerSeqNo(peer_seqno);
+			pkt->putS32(0, bitmap);
+			offset += 8;
+		}
+		return (true);
+	};
+
+	/* cumulative acknowledgement, "peer" is the next expected sequence number */
+	void ack(uint8_t peer) {
+		const uint8_t delta = peer - ack_seqno;
+
+		if (delta == 0 || delta > inflight())
+			return;
+
+		while (ack_seqno != peer) {
+			struct hpsjam_window_slot &slot = window[ack_seqno % HPSJAM_WINDOW_MAX];
+
+			/* only sample round trip time from packets sent once */
+			if (slot.resent == false)
+				ping_time = hpsjam_ticks - slot.first_time;
+			delete slot.pkt;
+			slot.pkt = 0;
+			ack_seqno++;
+		}
+		pend_count = 1;
+	};
+
+	void selective_ack(uint8_t peer, uint32_t bitmap) {
+		ack(peer);
+
+		for (unsigned x = 1; x != HPSJAM_WINDOW_MAX; x++) {
+			const uint8_t seq = peer + x;
+
+			if (~bitmap & (1U << (x - 1)))
+				continue;
+			if ((uint8_t)(seq - ack_seqno) >= inflight())
+				break;
+			window[seq % HPSJAM_WINDOW_MAX].sacked = true;
+		}
+	};
+
+	/* returns true if the given sequenced packet should be processed now */
+	bool rx_sequenced(const struct hpsjam_packet &packet) {
+		const uint8_t rx_seqno = packet.getLocalSeqNo();
+		const uint8_t delta = rx_seqno - peer_seqno;
+		struct hpsjam_packet_data *&slot = rx_window[rx_seqno % HPSJAM_WINDOW_MAX];
+
+		send_ack = true;
+
+		if (delta == 0) {
+			if (slot != 0) {
+				slot->unref();
+				slot = 0;
+			}
+			peer_seqno++;
 			return (true);
+		} else if (delta < HPSJAM_WINDOW_MAX && slot == 0) {
+			/* keep out-of-order packet until the gap is filled */
+			slot = new struct hpsjam_packet_data;
+			memcpy(slot->raw, &packet, packet.getBytes());
 		}
 		return (false);
 	};
 
-	void advance() {
-		if (pending == 0)
-			return;
-		delete pending;
-		pending = 0;
-		ping_time = hpsjam_ticks - start_time;
+	/* returns the next buffered in-order packet, if any */
+	struct hpsjam_packet_data *rx_next() {
+		struct hpsjam_packet_data *&slot = rx_window[peer_seqno % HPSJAM_WINDOW_MAX];
+		struct hpsjam_packet_data *retval = slot;
+
+		if (retval != 0) {
+			slot = 0;
+			peer_seqno++;
+		}
+		return (retval);
+	};
+
+	uint16_t retransmit_timeout() const {
+		if (ping_time == 0)
+			return (64);
+		else if (ping_time > 512)
+			return (768);
+		else
+			return (ping_time + (ping_time / 2) + 8);
 	};
 
 	bool isXorFrame() const {
@@ -415,34 +618,46 @@ public:
 			/* finalize XOR packet */
 			mask.hdr.setSequence(seqno);
 			addr.sendto((const char *)&mask, d_len + sizeof(mask.hdr));
-			mask.clear();
+			mask.clear(d_len + sizeof(mask.hdr));
 			d_len = 0;
 		} else {
-			/* add a control packet, if possible */
-			if (pending == 0) {
-				pending = TAILQ_FIRST(&head);
-				if (pending != 0) {
-					pending->remove(&head);
-					pending->packet.setLocalSeqNo(pend_seqno);
-					pending->packet.setPeerSeqNo(peer_seqno);
-					start_time = hpsjam_ticks;
-					pend_seqno++;
-					if (append_pkt(*pending))
-						send_ack = false;
-					pend_count = 1;
-				} else if (pend_count != 65535) {
-					pend_count++;
-				}
-			} else {
-				if ((pend_count % 64) == 0) {
-					pending->packet.setPeerSeqNo(peer_seqno);
-					if (append_pkt(*pending))
-						send_ack = false;
-					pend_count++;
-				} else if (pend_count != 65535) {
-					pend_count++;
-				}
+			struct hpsjam_packet_entry *pkt;
+			const uint16_t rto = retransmit_timeout();
+
+			/* retransmit lost control packets, if any */
+			for (uint8_t x = ack_seqno; x != pend_seqno; x++) {
+				struct hpsjam_window_slot &slot = window[x % HPSJAM_WINDOW_MAX];
+
+				if (slot.sacked || (uint16_t)(hpsjam_ticks - slot.send_time) < rto)
+					continue;
+				if (append_pkt(*slot.pkt) == false)
+					break;
+				slot.send_time = hpsjam_ticks;
+				slot.resent = true;
+				send_ack = false;
 			}
+
+			/* add new control packets, if possible */
+			while (inflight() < HPSJAM_WINDOW_MAX &&
+			       (pkt = TAILQ_FIRST(&head)) != 0 &&
+			       can_append(pkt->data->packet.getBytes())) {
+				struct hpsjam_window_slot &slot = window[pend_seqno % HPSJAM_WINDOW_MAX];
+
+				if (inflight() == 0)
+					pend_count = 0;
+				pkt->remove(&head);
+				pkt->seqno = pend_seqno;
+				slot.pkt = pkt;
+				slot.first_time = slot.send_time = hpsjam_ticks;
+				slot.sacked = false;
+				slot.resent = false;
+				pend_seqno++;
+				append_pkt(*pkt);
+				send_ack = false;
+			}
+
+			if (pend_count != 65535)
+				pend_count++;
 			if (pend_count == 1000)
 				emit pendingWatchdog();
 			else if (pend_count == 2000)
@@ -451,10 +666,16 @@ public:
 			/* check if we need to send an ACK */
 			if (send_ack && append_ack())
 				send_ack = false;
+
+			/* use spare room for telemetry, if any */
+			if (telemetry != 0 && append_pkt(telemetry->packet)) {
+				telemetry->unref();
+				telemetry = 0;
+			}
 			current.hdr.setSequence(seqno);
 			addr.sendto((const char *)&current, offset + sizeof(current.hdr));
-			mask.do_xor(current);
-			current.clear();
+			mask.do_xor(current, offset + sizeof(current.hdr));
+			current.clear(offset + sizeof(current.hdr));
 			/* keep track of maximum XOR length */
 			if (d_len < offset)
 				d_len = offset;
@@ -473,23 +694,73 @@ struct hpsjam_time_variance {
 	int32_t port;
 };
 
+struct hpsjam_frame_slot {
+	uint32_t pos;	/* arena position */
+	uint16_t len;	/* frame length in bytes, excluding header */
+};
+
 struct hpsjam_input_packetizer {
 	struct hpsjam_jitter jitter;
-	union hpsjam_frame current[HPSJAM_SEQ_MAX];
+	union hpsjam_frame output;	/* frame returned by first_pkt() */
+	uint8_t arena[HPSJAM_ARENA_SIZE];	/* received frame data */
+	struct hpsjam_frame_slot slot[HPSJAM_SEQ_MAX];
+	uint32_t arena_pos;
 	int32_t time_variance[HPSJAM_PORTS_MAX];
-	uint8_t valid[HPSJAM_SEQ_MAX];
+	uint64_t valid[(HPSJAM_SEQ_MAX + 63) / 64];	/* received frames */
+	uint64_t group_mask;	/* groups having received frames */
 	uint8_t last_seqno;
-#define	HPSJAM_MASK_VALID 1
+#define	HPSJAM_GROUP_FRAMES 5
+#define	HPSJAM_GROUP_MAX (HPSJAM_SEQ_MAX / HPSJAM_GROUP_FRAMES)
+#if (HPSJAM_GROUP_MAX > 64 || (HPSJAM_SEQ_MAX % HPSJAM_GROUP_FRAMES))
+#error "HPSJAM_GROUP_MAX must fit a 64-bit mask"
+#endif
 
 	void init() {
 		jitter.clear();
-		for (size_t x = 0; x != HPSJAM_SEQ_MAX; x++)
-			current[x].clear();
+		memset(slot, 0, sizeof(slot));
 		memset(valid, 0, sizeof(valid));
 		memset(time_variance, 0, sizeof(time_variance));
+		arena_pos = 0;
+		group_mask = 0;
 		last_seqno = 0;
 	};
 
+	/* check if the frame data has not been overwritten by newer frames */
+	bool isLive(unsigned x) const {
+		return ((uint32_t)(arena_pos - slot[x].pos) <= HPSJAM_ARENA_SIZE);
+	};
+
+	bool isValid(unsigned x) const {
+		return (((valid[x / 64] >> (x % 64)) & 1) && isLive(x));
+	};
+
+	void setValid(unsigned x) {
+		valid[x / 64] |= 1ULL << (x % 64);
+		group_mask |= 1ULL << (x / HPSJAM_GROUP_FRAMES);
+	};
+
+	void clearValid(unsigned x) {
+		const unsigned g = x / HPSJAM_GROUP_FRAMES;
+		const unsigned b = g * HPSJAM_GROUP_FRAMES;
+		uint64_t bits;
+
+		valid[x / 64] &= ~(1ULL << (x % 64));
+
+		/* update group mask */
+		bits = valid[b / 64] >> (b % 64);
+		if ((b % 64) + HPSJAM_GROUP_FRAMES > 64)
+			bits |= valid[b / 64 + 1] << (64 - (b % 64));
+		if ((bits & ((1U << HPSJAM_GROUP_FRAMES) - 1)) == 0)
+			group_mask &= ~(1ULL << g);
+	};
+
+	const uint8_t *getData(unsigned x) const {
+		return (arena + (slot[x].pos % HPSJAM_ARENA_SIZE));
+	};
+
+	const union hpsjam_frame *get_frame(unsigned);
+	const union hpsjam_frame *get_xor_frame(unsigned, unsigned);
+
 	void reset_time_variance() {
 		memset(time_variance, 0, sizeof(time_variance));
 	};
@@ -498,7 +769,7 @@ struct hpsjam_input_packetizer {
 
 	const union hpsjam_frame *first_pkt(bool low_water);
 
-	void receive(const union hpsjam_frame &frame) {
+	void receive(const union hpsjam_frame &frame, size_t len) {
 		const uint8_t rx_seqno = frame.hdr.getSequence();
 		unsigned delta = (HPSJAM_SEQ_MAX + rx_seqno - (unsigned)last_seqno) % HPSJAM_SEQ_MAX;
 
@@ -514,8 +785,21 @@ struct hpsjam_input_packetizer {
 			time_variance[rx_seqno % HPSJAM_PORTS_MAX] += delta;
 		}
 
-		current[rx_seqno] = frame;
-		valid[rx_seqno] = HPSJAM_MASK_VALID;
+		if (len < sizeof(frame.hdr))
+			return;
+		len -= sizeof(frame.hdr);
+		if (len > sizeof(frame) - sizeof(frame.hdr))
+			len = sizeof(frame) - sizeof(frame.hdr);
+
+		/* frames are stored contiguously, so skip to start of arena, if needed */
+		if ((arena_pos % HPSJAM_ARENA_SIZE) + len > HPSJAM_ARENA_SIZE)
+			arena_pos += HPSJAM_ARENA_SIZE - (arena_pos % HPSJAM_ARENA_SIZE);
+
+		memcpy(arena + (arena_pos % HPSJAM_ARENA_SIZE), frame.start, len);
+		slot[rx_seqno].pos = arena_pos;
+		slot[rx_seqno].len = len;
+		arena_pos += len;
+		setValid(rx_seqno);
 	};
 };
 
@@ -81,7 +81,7 @@ hpsjam_socket_receive(void *arg)
 			/* zero end of frame to avoid garbage */
 			memset(frame.raw + ret, 0, sizeof(frame) - ret);
 			/* process frame */
-			hpsjam_peer_receive(*ps, self, frame);
+			hpsjam_peer_receive(*ps, self, frame, ret);
 		}
 	}
 done:
@@ -23,6 +23,9 @@
  * SUCH DAMAGE.
  */
 
+#include <algorithm>
+#include <functional>
+
 #include "hpsjam.h"
 #include "spectralysis.h"
 
@@ -57,26 +60,10 @@ hpsjam_create_ping_pong_buffer(const float *src, float *dst, size_t last, size_t
 
 	if (src[(num - 2 + last) % num] > last_sample) {
 		/* going down */
-		for (size_t i = 0; i != num; i++) {
-			for (size_t j = i + 1; j != num; j++) {
-				if (temp[i] > temp[j]) {
-					float t = temp[j];
-					temp[j] = temp[i];
-					temp[i] = t;
-				}
-			}
-		}
+		std::sort(temp, temp + num);
 	} else {
 		/* going up */
-		for (size_t i = 0; i != num; i++) {
-			for (size_t j = i + 1; j != num; j++) {
-				if (temp[i] < temp[j]) {
-					float t = temp[j];
-					temp[j] = temp[i];
-					temp[i] = t;
-				}
-			}
-		}
+		std::sort(temp, temp + num, std::greater<float>());
 	}
 
 	/* make sure frequency is even */
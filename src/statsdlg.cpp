@@ -57,18 +57,18 @@ HpsJamStatsGraph :: paintEvent(QPaintEvent *event)
 	if (1) {
 		QMutexLocker locker(&hpsjam_client_peer->lock);
 
-		assert(sizeof(stats) >= sizeof(hpsjam_client_peer->input_pkt.jitter.stats));
-		memcpy(stats, hpsjam_client_peer->input_pkt.jitter.stats, sizeof(stats));
-		packet_recover = hpsjam_client_peer->input_pkt.jitter.packet_recover;
-		packet_damage = hpsjam_client_peer->input_pkt.jitter.packet_damage;
+		assert(sizeof(stats) >= sizeof(hpsjam_client_peer->input_pkt->jitter.stats));
+		memcpy(stats, hpsjam_client_peer->input_pkt->jitter.stats, sizeof(stats));
+		packet_recover = hpsjam_client_peer->input_pkt->jitter.packet_recover;
+		packet_damage = hpsjam_client_peer->input_pkt->jitter.packet_damage;
 		ping_time = hpsjam_client_peer->output_pkt.ping_time;
-		jitter_time = hpsjam_client_peer->input_pkt.jitter.get_jitter_in_ms();
-		low_water[0] = hpsjam_client_peer->in_audio[0].low_water;
-		low_water[1] = hpsjam_client_peer->out_audio[0].low_water;
-		high_water[0] = hpsjam_client_peer->in_audio[0].high_water;
-		high_water[1] = hpsjam_client_peer->out_audio[0].high_water;
-		adjust[0] = hpsjam_client_peer->in_audio[0].getWaterRef();
-		adjust[1] = hpsjam_client_peer->out_audio[0].getWaterRef();
+		jitter_time = hpsjam_client_peer->input_pkt->jitter.get_jitter_in_ms();
+		low_water[0] = hpsjam_client_peer->in_audio.low_water;
+		low_water[1] = hpsjam_client_peer->out_audio.low_water;
+		high_water[0] = hpsjam_client_peer->in_audio.high_water;
+		high_water[1] = hpsjam_client_peer->out_audio.high_water;
+		adjust[0] = hpsjam_client_peer->in_audio.getWaterRef();
+		adjust[1] = hpsjam_client_peer->out_audio.getWaterRef();
 		memcpy(ports, hpsjam_client_peer->output_pkt.port_mapping, sizeof(ports));
 	}
 
@@ -40,6 +40,8 @@ static QElapsedTimer hpsjam_timer;
 #include "hpsjam.h"
 #include "timer.h"
 #include "peer.h"
+#include "denormal.h"
+#include "equalizer.h"
 
 #include <QWaitCondition>
 
@@ -65,6 +67,7 @@ static void *
 hpsjam_timer_loop(void *)
 {
 	hpsjam_timer_set_priority();
+	hpsjam_denormal_disable();
 
 #ifdef _WIN32
 	hpsjam_timer.start();
@@ -159,6 +162,10 @@ hpsjam_execute_thread(void *arg)
 	const unsigned shift = (unsigned)((uint8_t *)arg - (uint8_t *)0);
 	const uint64_t mask = 1ULL << shift;
 
+	/* the timer thread is worker zero */
+	if (mask != 1)
+		hpsjam_denormal_disable();
+
 	hpsjam_execute_mtx.lock();
 
 	do {
@@ -208,6 +215,9 @@ hpsjam_timer_init()
 	ret = pthread_create(&pt, 0, &hpsjam_timer_loop, 0);
 	assert(ret == 0);
 
+	/* create equalizer design thread */
+	hpsjam_equalizer_worker_init();
+
 	/* create additional worker threads, if any */
 	for (unsigned x = 1; x != hpsjam_num_cpu; x++) {
 		ret = pthread_create(&pt, 0, &hpsjam_execute_thread, (void *)(((uint8_t *)0) + x));